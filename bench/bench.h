@@ -0,0 +1,92 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdio.h>
+#include "meshfile.h"
+
+struct bench_options {
+	long size;			/* triangles in the synthetic scene */
+	int iter;			/* iterations per stage, 0 for the suite default */
+	int warmup;			/* untimed iterations before measuring */
+	int threads[16];	/* thread counts for the kernel and scaling benchmarks */
+	int num_threads;
+	const char *tmpdir;
+	int keep;			/* keep temporary files */
+	int cputime;		/* time with the process CPU time instead of wall-clock time */
+	unsigned int fmtmask;	/* formats to run, bit per MF_FMT_* */
+};
+
+struct bench_result {
+	const char *suite, *name, *stage;
+	long size;			/* triangles processed */
+	int threads;
+	int iter;			/* timed iterations */
+	double sec;			/* best time in seconds */
+	double med, p90;	/* median and 90th percentile times */
+	double mbytes;		/* data read or written in MB, 0 if not applicable */
+	long rss_kb;		/* peak resident set size during the stage */
+	double speedup, eff;	/* scaling suite: relative to the fewest threads */
+	int fail, flat;		/* flat: scaling flattened out at this thread count */
+};
+
+extern struct bench_options bopt;
+
+double bench_time(void);
+void bench_reset_peak(void);
+long bench_peak_rss(void);
+
+/* fills in the time fields of res from the times of n iterations */
+void bench_stats(struct bench_result *res, double *times, int n);
+
+int bench_add_result(const struct bench_result *res);
+void bench_write_csv(FILE *fp);
+void bench_write_json(FILE *fp);
+void bench_free_results(void);
+
+/* compares the median times of the results so far against a baseline CSV file
+ * written by bench_write_csv, and reports every result which got slower by more
+ * than tol percent, or which fails now but didn't in the baseline. If both have
+ * a calib result, and calibration is slower now, baseline times are first scaled
+ * up by the difference. Returns the number of regressions, or -1 if the baseline
+ * can't be read.
+ */
+int bench_compare(const char *fname, double tol);
+
+/* deterministic synthetic scene, made of tessellated tori with at most 32k
+ * triangles each (to stay within 3DS limits). Returns the scene, and the
+ * actual number of triangles in ntris.
+ */
+struct mf_meshfile *bench_gen_scene(long *ntris);
+long bench_count_tris(const struct mf_meshfile *mf);
+
+/* single meshes of roughly ntris triangles, for the kernel benchmarks: a
+ * regular grid and a sphere with shared vertices, and a noisy triangle soup
+ * with unique vertices per face, like the output of a 3D scanner.
+ */
+struct mf_mesh *bench_gen_grid(long ntris);
+struct mf_mesh *bench_gen_sphere(long ntris);
+struct mf_mesh *bench_gen_soup(long ntris);
+
+int bench_calibrate(void);
+int bench_formats(void);
+int bench_kernels(void);
+int bench_scaling(void);
+
+#endif	/* BENCH_H_ */
@@ -0,0 +1,85 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+/* A fixed CPU workload, timed in the same process as the other benchmarks, so
+ * that bench_compare can tell a slower machine (or a slow moment on a busy one)
+ * from a slower library. A mix of streaming float math and dependent integer
+ * work, loosely like parsing and processing a mesh.
+ */
+#define CALIB_SIZE		(1 << 18)
+#define CALIB_PASSES	16
+#define CALIB_ITER		15
+
+static unsigned int calib_run(float *buf);
+
+int bench_calibrate(void)
+{
+	int i;
+	float *buf;
+	double t0, times[CALIB_ITER];
+	unsigned int sum = 0;
+	struct bench_result br;
+
+	if(!(buf = malloc(CALIB_SIZE * sizeof *buf))) {
+		fprintf(stderr, "failed to allocate calibration buffer\n");
+		return -1;
+	}
+	for(i=0; i<CALIB_SIZE; i++) {
+		buf[i] = (float)(i & 0xff) / 255.0f;
+	}
+
+	for(i=0; i<bopt.warmup; i++) {
+		sum += calib_run(buf);
+	}
+	for(i=0; i<CALIB_ITER; i++) {
+		t0 = bench_time();
+		sum += calib_run(buf);
+		times[i] = bench_time() - t0;
+	}
+	free(buf);
+
+	memset(&br, 0, sizeof br);
+	br.suite = "calib";
+	br.name = "cpu";
+	br.stage = "mix";
+	br.size = CALIB_SIZE;
+	br.threads = 1;
+	br.fail = sum == 0xffffffff;	/* keeps the work from being optimized out */
+	bench_stats(&br, times, CALIB_ITER);
+	br.rss_kb = bench_peak_rss();
+	return bench_add_result(&br);
+}
+
+static unsigned int calib_run(float *buf)
+{
+	int i, j;
+	float x;
+	unsigned int h = 2166136261u;
+
+	for(i=0; i<CALIB_PASSES; i++) {
+		for(j=0; j<CALIB_SIZE; j++) {
+			x = buf[j] * 1.0009765625f + 0.25f;
+			buf[j] = x - (float)(int)x;
+			h = (h ^ (unsigned int)(x * 1024.0f)) * 16777619u;
+		}
+	}
+	return h;
+}
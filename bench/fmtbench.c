@@ -0,0 +1,178 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "bench.h"
+
+/* must match MF_FMT enums in meshfile.h */
+static const char *fmtname[] = {0, "obj", "jtf", "gltf", "3ds", "stl"};
+
+#define DEF_ITER	3
+
+static void bench_format(struct mf_meshfile *mf, int fmt, int gz, long ntris, double *times,
+		int iter);
+static void add_result(const char *fmt, const char *stage, long ntris, double *times,
+		int n, long fsize, long rss, int fail);
+static long file_size(const char *path);
+static void remove_files(const char *path, int fmt);
+
+int bench_formats(void)
+{
+	int fmt, iter;
+	long ntris;
+	double *times;
+	struct mf_meshfile *mf;
+
+	iter = bopt.iter > 0 ? bopt.iter : DEF_ITER;
+	if(!(times = malloc(iter * sizeof *times))) {
+		return -1;
+	}
+
+	ntris = bopt.size;
+	fprintf(stderr, "generating synthetic scene (%ld triangles) ...\n", ntris);
+	if(!(mf = bench_gen_scene(&ntris))) {
+		free(times);
+		return -1;
+	}
+
+	for(fmt=1; fmt<MF_NUM_FMT; fmt++) {
+		if(!(bopt.fmtmask & (1 << fmt))) continue;
+
+		bench_format(mf, fmt, 0, ntris, times, iter);
+		/* also exercises loading several compressed files in a row */
+		bench_format(mf, fmt, 1, ntris, times, iter);
+	}
+
+	mf_free(mf);
+	free(times);
+	return 0;
+}
+
+static void bench_format(struct mf_meshfile *mf, int fmt, int gz, long ntris, double *times,
+		int iter)
+{
+	int i, n, res;
+	long fsize, rss, loaded;
+	double t0;
+	char path[512];
+	struct mf_meshfile *lmf;
+
+	sprintf(path, "%s/mfbench.%s%s", bopt.tmpdir, fmtname[fmt], gz ? ".gz" : "");
+
+	/* save */
+	rss = 0;
+	res = 0;
+	n = 0;
+	for(i=0; i<bopt.warmup + iter; i++) {
+		bench_reset_peak();
+		t0 = bench_time();
+		res = mf_save(mf, path, fmt);
+		if(i >= bopt.warmup) {
+			times[n++] = bench_time() - t0;
+		}
+		if(res == -1) break;
+		if(bench_peak_rss() > rss) rss = bench_peak_rss();
+	}
+	fsize = file_size(path);
+	add_result(fmtname[fmt], gz ? "gzsave" : "save", ntris, times, n, fsize, rss,
+			res == -1 || fsize <= 0);
+	if(res == -1 || fsize <= 0) {
+		remove_files(path, fmt);
+		return;
+	}
+
+	/* load */
+	rss = 0;
+	loaded = 0;
+	n = 0;
+	for(i=0; i<bopt.warmup + iter; i++) {
+		if(!(lmf = mf_alloc())) {
+			res = -1;
+			break;
+		}
+		bench_reset_peak();
+		t0 = bench_time();
+		res = mf_load(lmf, path, MF_NOPROC);
+		if(i >= bopt.warmup) {
+			times[n++] = bench_time() - t0;
+		}
+		if(bench_peak_rss() > rss) rss = bench_peak_rss();
+		loaded = res == -1 ? 0 : bench_count_tris(lmf);
+		mf_free(lmf);
+		if(res == -1) break;
+	}
+	if(res != -1 && loaded != ntris) {
+		fprintf(stderr, "%s: loaded %ld triangles, expected %ld\n", fmtname[fmt],
+				loaded, ntris);
+		res = -1;
+	}
+	add_result(fmtname[fmt], gz ? "gzload" : "load", ntris, times, n, fsize, rss, res == -1);
+
+	if(!bopt.keep) {
+		remove_files(path, fmt);
+	}
+}
+
+static void add_result(const char *fmt, const char *stage, long ntris, double *times,
+		int n, long fsize, long rss, int fail)
+{
+	struct bench_result res;
+
+	memset(&res, 0, sizeof res);
+	res.suite = "formats";
+	res.name = fmt;
+	res.stage = stage;
+	res.size = ntris;
+	res.threads = 1;
+	bench_stats(&res, times, n);
+	res.mbytes = fsize > 0 ? (double)fsize / 1048576.0 : 0.0;
+	res.rss_kb = rss;
+	res.fail = fail;
+	bench_add_result(&res);
+}
+
+static long file_size(const char *path)
+{
+	struct stat st;
+
+	if(stat(path, &st) == -1) {
+		return -1;
+	}
+	return (long)st.st_size;
+}
+
+static void remove_files(const char *path, int fmt)
+{
+	char *mtlpath, *suffix;
+
+	remove(path);
+
+	/* OBJ also writes a material library next to the file */
+	if(fmt == MF_FMT_OBJ && (mtlpath = malloc(strlen(path) + 1))) {
+		strcpy(mtlpath, path);
+		if((suffix = strrchr(mtlpath, '.')) && strcmp(suffix, ".gz") == 0) {
+			*suffix = 0;	/* foo.obj.gz -> foo.mtl */
+		}
+		if((suffix = strrchr(mtlpath, '.'))) {
+			strcpy(suffix, ".mtl");
+			remove(mtlpath);
+		}
+		free(mtlpath);
+	}
+}
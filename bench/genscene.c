@@ -0,0 +1,311 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "bench.h"
+
+#ifndef M_PI
+#define M_PI	3.14159265358979323846
+#endif
+
+#define USEG	128
+#define MAX_VSEG	128
+
+static struct mf_mesh *gen_torus(int useg, int vseg, float rad, float rrad);
+
+struct mf_meshfile *bench_gen_scene(long *ntris)
+{
+	int i, vseg, nmeshes;
+	long left;
+	char name[32];
+	float xform[16];
+	struct mf_meshfile *mf;
+	struct mf_material *mtl;
+	struct mf_mesh *mesh;
+	struct mf_node *node;
+
+	if(!(mf = mf_alloc())) {
+		return 0;
+	}
+
+	if(!(mtl = mf_alloc_mtl()) || !(mtl->name = strdup("bench_mtl"))) {
+		goto err;
+	}
+	mtl->attr[MF_COLOR].val.x = 0.8f;
+	mtl->attr[MF_COLOR].val.y = 0.6f;
+	mtl->attr[MF_COLOR].val.z = 0.4f;
+	if(mf_add_material(mf, mtl) == -1) {
+		mf_free_mtl(mtl);
+		goto err;
+	}
+
+	nmeshes = (*ntris + USEG * MAX_VSEG * 2 - 1) / (USEG * MAX_VSEG * 2);
+	left = *ntris;
+	*ntris = 0;
+	for(i=0; i<nmeshes; i++) {
+		vseg = (left + USEG * 2 - 1) / (USEG * 2);
+		if(vseg > MAX_VSEG) vseg = MAX_VSEG;
+		if(vseg < 3) vseg = 3;
+
+		if(!(mesh = gen_torus(USEG, vseg, 1.0f, 0.25f + (i & 3) * 0.05f))) {
+			goto err;
+		}
+		mesh->mtl = mtl;
+		sprintf(name, "torus%d", i);
+		if(!(mesh->name = strdup(name)) || mf_add_mesh(mf, mesh) == -1) {
+			mf_free_mesh(mesh);
+			goto err;
+		}
+		left -= mesh->num_faces;
+		*ntris += mesh->num_faces;
+
+		if(!(node = mf_alloc_node())) {
+			goto err;
+		}
+		sprintf(name, "node%d", i);
+		if(!(node->name = strdup(name)) || mf_node_add_mesh(node, mesh) == -1 ||
+				mf_add_node(mf, node) == -1) {
+			mf_free_node(node);
+			goto err;
+		}
+		memset(xform, 0, sizeof xform);
+		xform[0] = xform[5] = xform[10] = xform[15] = 1.0f;
+		xform[12] = (float)(i % 16) * 3.0f;
+		xform[14] = (float)(i / 16) * 3.0f;
+		mf_node_set_matrix(node, xform);
+	}
+	mf_update_xform(mf);
+	return mf;
+
+err:
+	fprintf(stderr, "failed to generate benchmark scene\n");
+	mf_free(mf);
+	return 0;
+}
+
+long bench_count_tris(const struct mf_meshfile *mf)
+{
+	int i, num = mf_num_meshes(mf);
+	long count = 0;
+
+	for(i=0; i<num; i++) {
+		count += mf_get_mesh(mf, i)->num_faces;
+	}
+	return count;
+}
+
+static struct mf_mesh *gen_torus(int useg, int vseg, float rad, float rrad)
+{
+	int i, j, vidx;
+	float u, v, su, cu, sv, cv;
+	mf_vec3 norm;
+	struct mf_mesh *mesh;
+
+	if(!(mesh = mf_alloc_mesh())) {
+		return 0;
+	}
+
+	for(i=0; i<=vseg; i++) {
+		v = (float)i / (float)vseg;
+		sv = sin(v * 2.0 * M_PI);
+		cv = cos(v * 2.0 * M_PI);
+		for(j=0; j<=useg; j++) {
+			u = (float)j / (float)useg;
+			su = sin(u * 2.0 * M_PI);
+			cu = cos(u * 2.0 * M_PI);
+
+			norm.x = cv * cu;
+			norm.y = sv;
+			norm.z = cv * su;
+			if(mf_add_vertex(mesh, cu * rad + norm.x * rrad, norm.y * rrad,
+						su * rad + norm.z * rrad) == -1 ||
+					mf_add_normal(mesh, norm.x, norm.y, norm.z) == -1 ||
+					mf_add_texcoord(mesh, u, v) == -1) {
+				goto err;
+			}
+		}
+	}
+
+	for(i=0; i<vseg; i++) {
+		for(j=0; j<useg; j++) {
+			vidx = i * (useg + 1) + j;
+			if(mf_add_quad(mesh, vidx, vidx + 1, vidx + useg + 2, vidx + useg + 1) == -1) {
+				goto err;
+			}
+		}
+	}
+	return mesh;
+
+err:
+	mf_free_mesh(mesh);
+	return 0;
+}
+
+struct mf_mesh *bench_gen_grid(long ntris)
+{
+	int i, j, vidx, nseg;
+	float u, v;
+	struct mf_mesh *mesh;
+
+	nseg = (int)sqrt(ntris / 2.0);
+	if(nseg < 1) nseg = 1;
+
+	if(!(mesh = mf_alloc_mesh()) || !(mesh->name = strdup("grid"))) {
+		goto err;
+	}
+	for(i=0; i<=nseg; i++) {
+		v = (float)i / (float)nseg;
+		for(j=0; j<=nseg; j++) {
+			u = (float)j / (float)nseg;
+			if(mf_add_vertex(mesh, u * 2.0f - 1.0f, 0.0f, v * 2.0f - 1.0f) == -1 ||
+					mf_add_normal(mesh, 0.0f, 1.0f, 0.0f) == -1 ||
+					mf_add_texcoord(mesh, u, v) == -1) {
+				goto err;
+			}
+		}
+	}
+	for(i=0; i<nseg; i++) {
+		for(j=0; j<nseg; j++) {
+			vidx = i * (nseg + 1) + j;
+			if(mf_add_quad(mesh, vidx, vidx + nseg + 1, vidx + nseg + 2, vidx + 1) == -1) {
+				goto err;
+			}
+		}
+	}
+	return mesh;
+
+err:
+	mf_free_mesh(mesh);
+	return 0;
+}
+
+struct mf_mesh *bench_gen_sphere(long ntris)
+{
+	int i, j, vidx, useg, vseg;
+	float u, v, theta, phi;
+	mf_vec3 n;
+	struct mf_mesh *mesh;
+
+	vseg = (int)sqrt(ntris / 4.0);
+	if(vseg < 2) vseg = 2;
+	useg = vseg * 2;
+
+	if(!(mesh = mf_alloc_mesh()) || !(mesh->name = strdup("sphere"))) {
+		goto err;
+	}
+	for(i=0; i<=vseg; i++) {
+		v = (float)i / (float)vseg;
+		phi = v * M_PI;
+		for(j=0; j<=useg; j++) {
+			u = (float)j / (float)useg;
+			theta = u * 2.0 * M_PI;
+			n.x = sin(phi) * cos(theta);
+			n.y = cos(phi);
+			n.z = sin(phi) * sin(theta);
+			if(mf_add_vertex(mesh, n.x, n.y, n.z) == -1 ||
+					mf_add_normal(mesh, n.x, n.y, n.z) == -1 ||
+					mf_add_texcoord(mesh, u, v) == -1) {
+				goto err;
+			}
+		}
+	}
+	for(i=0; i<vseg; i++) {
+		for(j=0; j<useg; j++) {
+			vidx = i * (useg + 1) + j;
+			if(mf_add_quad(mesh, vidx, vidx + 1, vidx + useg + 2, vidx + useg + 1) == -1) {
+				goto err;
+			}
+		}
+	}
+	return mesh;
+
+err:
+	mf_free_mesh(mesh);
+	return 0;
+}
+
+/* deterministic pseudo-random numbers in [0, 1) */
+static float frand(unsigned int *state)
+{
+	*state = *state * 1103515245 + 12345;
+	return (float)((*state >> 8) & 0xffff) / 65536.0f;
+}
+
+struct mf_mesh *bench_gen_soup(long ntris)
+{
+	int i, j, k, nseg;
+	unsigned int seed = 0x5eed;
+	float x, z, h;
+	mf_vec3 v[4];
+	struct mf_mesh *mesh;
+	static const int quadtri[][3] = {{0, 1, 2}, {0, 2, 3}};
+	static const float offs[][2] = {{0, 0}, {0, 1}, {1, 1}, {1, 0}};
+
+	nseg = (int)sqrt(ntris / 2.0);
+	if(nseg < 1) nseg = 1;
+
+	if(!(mesh = mf_alloc_mesh()) || !(mesh->name = strdup("soup"))) {
+		goto err;
+	}
+
+	/* noisy height field, with every triangle having its own vertices, and
+	 * faces in scan order
+	 */
+	for(i=0; i<nseg; i++) {
+		for(j=0; j<nseg; j++) {
+			for(k=0; k<4; k++) {
+				x = (float)(j + offs[k][0]) / (float)nseg * 2.0f - 1.0f;
+				z = (float)(i + offs[k][1]) / (float)nseg * 2.0f - 1.0f;
+				h = sin(x * 5.0f) * cos(z * 3.0f) * 0.2f + frand(&seed) * 0.01f;
+				v[k].x = x;
+				v[k].y = h;
+				v[k].z = z;
+			}
+			for(k=0; k<2; k++) {
+				int vidx = mesh->num_verts;
+				const int *qt = quadtri[k];
+
+				if(mf_add_vertex(mesh, v[qt[0]].x, v[qt[0]].y, v[qt[0]].z) == -1 ||
+						mf_add_vertex(mesh, v[qt[1]].x, v[qt[1]].y, v[qt[1]].z) == -1 ||
+						mf_add_vertex(mesh, v[qt[2]].x, v[qt[2]].y, v[qt[2]].z) == -1) {
+					goto err;
+				}
+				if(mf_add_triangle(mesh, vidx, vidx + 1, vidx + 2) == -1) {
+					goto err;
+				}
+			}
+		}
+	}
+
+	/* texture coordinates and normals for tangent generation */
+	for(i=0; i<(int)mesh->num_verts; i++) {
+		if(mf_add_texcoord(mesh, mesh->vertex[i].x * 0.5f + 0.5f,
+					mesh->vertex[i].z * 0.5f + 0.5f) == -1) {
+			goto err;
+		}
+	}
+	if(mf_calc_normals(mesh) == -1) {
+		goto err;
+	}
+	return mesh;
+
+err:
+	mf_free_mesh(mesh);
+	return 0;
+}
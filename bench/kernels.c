@@ -0,0 +1,520 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#ifndef MF_NO_THREADS
+#include <pthread.h>
+#endif
+#include "bench.h"
+#include "util.h"
+#include "json.h"
+
+#define DEF_ITER	11
+#define MIN_ITER	3
+#define MAX_TIME	5.0		/* stop repeating after this many seconds */
+
+struct kdata;
+
+struct kernel {
+	const char *name;
+	int (*setup)(struct kdata *kd, const struct mf_mesh *src);
+	int (*run)(struct kdata *kd);
+	int has_data;		/* report MB/s for the input text */
+};
+
+struct kdata {
+	const struct kernel *kern;
+	struct mf_mesh *mesh;
+	struct mf_meshfile *mf;
+	char *text;
+	long textlen, textmax;
+	void *buf;
+	long bufsz;
+	int res;
+};
+
+static int setup_clone(struct kdata *kd, const struct mf_mesh *src);
+static int setup_scene(struct kdata *kd, const struct mf_mesh *src);
+static int setup_b64(struct kdata *kd, const struct mf_mesh *src);
+static int setup_json(struct kdata *kd, const struct mf_mesh *src);
+static int setup_obj(struct kdata *kd, const struct mf_mesh *src);
+static void cleanup(struct kdata *kd);
+
+static int run_normals(struct kdata *kd);
+static int run_tangents(struct kdata *kd);
+static int run_transform(struct kdata *kd);
+static int run_aabox(struct kdata *kd);
+static int run_b64(struct kdata *kd);
+static int run_json(struct kdata *kd);
+static int run_objload(struct kdata *kd);
+
+static int run_threads(struct kdata *kd, int nthr);
+static int bench_kernel(const struct kernel *kern, const char *shape, const struct mf_mesh *src,
+		int nthr);
+
+static struct kernel kernels[] = {
+	{"normals", setup_clone, run_normals, 0},
+	{"tangents", setup_clone, run_tangents, 0},
+	{"transform", setup_clone, run_transform, 0},
+	{"aabox", setup_scene, run_aabox, 0},
+	{"b64decode", setup_b64, run_b64, 1},
+	{"json", setup_json, run_json, 1},
+	{"objdedup", setup_obj, run_objload, 1},
+	{0}
+};
+
+static struct {
+	const char *name;
+	struct mf_mesh *(*gen)(long);
+} shapes[] = {
+	{"grid", bench_gen_grid},
+	{"sphere", bench_gen_sphere},
+	{"soup", bench_gen_soup},
+	{0}
+};
+
+
+int bench_kernels(void)
+{
+	int i, j, k, t;
+	long size;
+	struct mf_mesh *src;
+
+	for(i=0; shapes[i].name; i++) {
+		/* sizes spanning two orders of magnitude, up to the -s size */
+		for(size = bopt.size / 100; size <= bopt.size; size *= 10) {
+			if(size < 100) continue;
+
+			fprintf(stderr, "generating %s (%ld triangles) ...\n", shapes[i].name, size);
+			if(!(src = shapes[i].gen(size))) {
+				fprintf(stderr, "failed to generate %s mesh\n", shapes[i].name);
+				return -1;
+			}
+			for(j=0; kernels[j].name; j++) {
+				for(k=0; k<bopt.num_threads; k++) {
+					t = bopt.threads[k];
+#ifdef MF_NO_THREADS
+					if(t > 1) continue;
+#endif
+					bench_kernel(kernels + j, shapes[i].name, src, t);
+				}
+			}
+			mf_free_mesh(src);
+		}
+	}
+	return 0;
+}
+
+static int bench_kernel(const struct kernel *kern, const char *shape, const struct mf_mesh *src,
+		int nthr)
+{
+	int i, n, iter, res = 0;
+	double t0, total, *times = 0;
+	struct kdata *kd;
+	struct bench_result br;
+
+	iter = bopt.iter > 0 ? bopt.iter : DEF_ITER;
+
+	if(!(kd = calloc(nthr, sizeof *kd)) || !(times = malloc(iter * sizeof *times))) {
+		res = -1;
+		goto end;
+	}
+	for(i=0; i<nthr; i++) {
+		kd[i].kern = kern;
+		if(kern->setup(kd + i, src) == -1) {
+			res = -1;
+			goto end;
+		}
+	}
+
+	for(i=0; i<bopt.warmup; i++) {
+		if((res = run_threads(kd, nthr)) == -1) {
+			goto end;
+		}
+	}
+
+	bench_reset_peak();
+	n = 0;
+	total = 0.0;
+	while(n < iter) {
+		t0 = bench_time();
+		res = run_threads(kd, nthr);
+		times[n] = bench_time() - t0;
+		total += times[n++];
+		if(res == -1) break;
+		if(n >= MIN_ITER && total > MAX_TIME) break;
+	}
+
+end:
+	memset(&br, 0, sizeof br);
+	br.suite = "kernels";
+	br.name = kern->name;
+	br.stage = shape;
+	br.size = (long)src->num_faces * nthr;
+	br.threads = nthr;
+	br.fail = res == -1;
+	if(!br.fail) {
+		bench_stats(&br, times, n);
+		if(kern->has_data) {
+			br.mbytes = (double)kd[0].textlen * nthr / 1048576.0;
+		}
+		br.rss_kb = bench_peak_rss();
+	}
+	bench_add_result(&br);
+
+	if(kd) {
+		for(i=0; i<nthr; i++) {
+			cleanup(kd + i);
+		}
+		free(kd);
+	}
+	free(times);
+	return res;
+}
+
+#ifndef MF_NO_THREADS
+static void *thread_func(void *arg)
+{
+	struct kdata *kd = arg;
+	kd->res = kd->kern->run(kd);
+	return 0;
+}
+#endif
+
+/* run the kernel on nthr independent inputs concurrently */
+static int run_threads(struct kdata *kd, int nthr)
+{
+	int i, res = 0;
+#ifndef MF_NO_THREADS
+	pthread_t *thr = 0;
+
+	if(nthr > 1) {
+		if(!(thr = malloc((nthr - 1) * sizeof *thr))) {
+			return -1;
+		}
+		for(i=1; i<nthr; i++) {
+			if(pthread_create(thr + i - 1, 0, thread_func, kd + i) != 0) {
+				kd[i].res = -1;
+				thr[i - 1] = pthread_self();
+			}
+		}
+	}
+#endif
+
+	kd->res = kd->kern->run(kd);
+
+#ifndef MF_NO_THREADS
+	for(i=1; i<nthr; i++) {
+		if(!pthread_equal(thr[i - 1], pthread_self())) {
+			pthread_join(thr[i - 1], 0);
+		}
+	}
+	free(thr);
+#endif
+
+	for(i=0; i<nthr; i++) {
+		if(kd[i].res == -1) res = -1;
+	}
+	return res;
+}
+
+static void cleanup(struct kdata *kd)
+{
+	if(kd->mf) {
+		mf_free(kd->mf);	/* owns the mesh */
+	} else {
+		mf_free_mesh(kd->mesh);
+	}
+	free(kd->text);
+	free(kd->buf);
+}
+
+
+/* ---- setup ---- */
+
+static int setup_clone(struct kdata *kd, const struct mf_mesh *src)
+{
+	if(!(kd->mesh = mf_clone_mesh(src)) || mf_unshare_mesh(kd->mesh) == -1) {
+		return -1;
+	}
+	return 0;
+}
+
+static int setup_scene(struct kdata *kd, const struct mf_mesh *src)
+{
+	struct mf_node *node;
+
+	if(setup_clone(kd, src) == -1 || !(kd->mf = mf_alloc())) {
+		return -1;
+	}
+	if(mf_add_mesh(kd->mf, kd->mesh) == -1) {
+		mf_free(kd->mf);
+		kd->mf = 0;
+		return -1;
+	}
+	if(!(node = mf_alloc_node()) || !(node->name = strdup("node")) ||
+			mf_node_add_mesh(node, kd->mesh) == -1 || mf_add_node(kd->mf, node) == -1) {
+		mf_free_node(node);
+		return -1;
+	}
+	return 0;
+}
+
+static int textf(struct kdata *kd, const char *fmt, ...)
+{
+	int len;
+	long newsz;
+	void *tmp;
+	va_list ap;
+
+	for(;;) {
+		va_start(ap, fmt);
+		len = vsnprintf(kd->text + kd->textlen, kd->textmax - kd->textlen, fmt, ap);
+		va_end(ap);
+
+		if(len >= 0 && kd->textlen + len < kd->textmax) {
+			kd->textlen += len;
+			return 0;
+		}
+		newsz = kd->textmax ? kd->textmax * 2 : 65536;
+		if(!(tmp = realloc(kd->text, newsz))) {
+			return -1;
+		}
+		kd->text = tmp;
+		kd->textmax = newsz;
+	}
+}
+
+static int setup_b64(struct kdata *kd, const struct mf_mesh *src)
+{
+	static const char b64chars[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	long i, size;
+	unsigned long grp;
+	const unsigned char *data = (const unsigned char*)src->vertex;
+	char *dest;
+
+	size = src->num_verts * sizeof *src->vertex;		/* multiple of 3 */
+	kd->textlen = size / 3 * 4;
+	if(!(kd->text = malloc(kd->textlen + 1)) || !(kd->buf = malloc(size))) {
+		return -1;
+	}
+	kd->bufsz = size;
+
+	dest = kd->text;
+	for(i=0; i<size; i+=3) {
+		grp = ((unsigned long)data[i] << 16) | ((unsigned long)data[i + 1] << 8) | data[i + 2];
+		*dest++ = b64chars[(grp >> 18) & 0x3f];
+		*dest++ = b64chars[(grp >> 12) & 0x3f];
+		*dest++ = b64chars[(grp >> 6) & 0x3f];
+		*dest++ = b64chars[grp & 0x3f];
+	}
+	*dest = 0;
+	return 0;
+}
+
+/* something shaped like a glTF file: lots of small node objects, accessors,
+ * and a long array of numbers
+ */
+static int setup_json(struct kdata *kd, const struct mf_mesh *src)
+{
+	unsigned int i;
+	mf_vec3 *v;
+
+	if(textf(kd, "{\n\"asset\": {\"version\": \"2.0\", \"generator\": \"meshfile bench\"},\n") == -1 ||
+			textf(kd, "\"nodes\": [\n") == -1) {
+		return -1;
+	}
+	for(i=0; i<src->num_faces; i+=4) {
+		v = src->vertex + src->faces[i].vidx[0];
+		if(textf(kd, "{\"name\": \"node%u\", \"mesh\": %u, \"translation\": [%g, %g, %g], "
+					"\"children\": [%u, %u]}%s\n", i / 4, i / 4, v->x, v->y, v->z, i, i + 1,
+					i + 4 < src->num_faces ? "," : "") == -1) {
+			return -1;
+		}
+	}
+	if(textf(kd, "],\n\"accessors\": [{\"bufferView\": 0, \"componentType\": 5126, "
+				"\"count\": %u, \"type\": \"VEC3\", \"min\": [-1, -1, -1], \"max\": [1, 1, 1]}],\n",
+				src->num_verts) == -1 || textf(kd, "\"extras\": {\"positions\": [") == -1) {
+		return -1;
+	}
+	for(i=0; i<src->num_verts; i++) {
+		v = src->vertex + i;
+		if(textf(kd, "%g, %g, %g%s", v->x, v->y, v->z, i < src->num_verts - 1 ? ", " : "") == -1) {
+			return -1;
+		}
+	}
+	return textf(kd, "]}\n}\n");
+}
+
+static int setup_obj(struct kdata *kd, const struct mf_mesh *src)
+{
+	unsigned int i;
+	struct mf_face *f;
+
+	for(i=0; i<src->num_verts; i++) {
+		if(textf(kd, "v %f %f %f\n", src->vertex[i].x, src->vertex[i].y, src->vertex[i].z) == -1) {
+			return -1;
+		}
+	}
+	for(i=0; i<src->num_verts; i++) {
+		if(textf(kd, "vn %f %f %f\n", src->normal[i].x, src->normal[i].y, src->normal[i].z) == -1) {
+			return -1;
+		}
+	}
+	for(i=0; i<src->num_verts; i++) {
+		if(textf(kd, "vt %f %f\n", src->texcoord[i].x, src->texcoord[i].y) == -1) {
+			return -1;
+		}
+	}
+	for(i=0; i<src->num_faces; i++) {
+		f = src->faces + i;
+		if(textf(kd, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", f->vidx[0] + 1, f->vidx[0] + 1,
+					f->vidx[0] + 1, f->vidx[1] + 1, f->vidx[1] + 1, f->vidx[1] + 1,
+					f->vidx[2] + 1, f->vidx[2] + 1, f->vidx[2] + 1) == -1) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+/* ---- kernels ---- */
+
+static int run_normals(struct kdata *kd)
+{
+	return mf_calc_normals(kd->mesh);
+}
+
+static int run_tangents(struct kdata *kd)
+{
+	return mf_calc_tangents(kd->mesh);
+}
+
+static int run_transform(struct kdata *kd)
+{
+	/* rotation by ~10 degrees about an oblique axis, keeps the mesh bounded */
+	static const float mat[] = {
+		0.9865f, 0.1190f, -0.1125f, 0,
+		-0.1065f, 0.9890f, 0.1030f, 0,
+		0.1235f, -0.0895f, 0.9883f, 0,
+		0, 0, 0, 1
+	};
+	mf_transform_mesh(kd->mesh, mat);
+	return 0;
+}
+
+static int run_aabox(struct kdata *kd)
+{
+	mf_aabox box;
+
+	mf_invalidate_mesh(kd->mesh);
+	return mf_bounds(kd->mf, &box);
+}
+
+static int run_b64(struct kdata *kd)
+{
+	long sz = kd->bufsz;
+	return mf_b64decode(kd->text, kd->buf, &sz) ? 0 : -1;
+}
+
+static int run_json(struct kdata *kd)
+{
+	int res;
+	struct json_obj root;
+
+	json_init_obj(&root);
+	res = json_parse(&root, kd->text);
+	json_destroy_obj(&root);
+	return res;
+}
+
+struct memfile {
+	const char *data;
+	long size, pos;
+};
+
+static void *mem_open(const char *fname, const char *mode)
+{
+	return 0;
+}
+
+static void mem_close(void *fp)
+{
+}
+
+static int mem_read(void *fp, void *buf, int sz)
+{
+	struct memfile *mem = fp;
+
+	if(sz > mem->size - mem->pos) {
+		sz = mem->size - mem->pos;
+	}
+	memcpy(buf, mem->data + mem->pos, sz);
+	mem->pos += sz;
+	return sz;
+}
+
+static long mem_seek(void *fp, long offs, int whence)
+{
+	struct memfile *mem = fp;
+
+	switch(whence) {
+	case MF_SEEK_CUR:
+		offs += mem->pos;
+		break;
+	case MF_SEEK_END:
+		offs += mem->size;
+		break;
+	default:
+		break;
+	}
+	if(offs < 0 || offs > mem->size) {
+		return -1;
+	}
+	mem->pos = offs;
+	return offs;
+}
+
+/* parse the OBJ text from memory, dominated by the v/vt/vn index dedup */
+static int run_objload(struct kdata *kd)
+{
+	int res;
+	struct mf_meshfile *mf;
+	struct mf_userio io = {0};
+	struct memfile mem;
+
+	mem.data = kd->text;
+	mem.size = kd->textlen;
+	mem.pos = 0;
+
+	io.file = &mem;
+	io.open = mem_open;
+	io.close = mem_close;
+	io.read = mem_read;
+	io.seek = mem_seek;
+
+	if(!(mf = mf_alloc())) {
+		return -1;
+	}
+	res = mf_load_userio(mf, &io, MF_NOPROC);
+	mf_free(mf);
+	return res;
+}
@@ -0,0 +1,297 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+
+struct bench_options bopt;
+
+static const char *fmtname[] = {0, "obj", "jtf", "gltf", "3ds", "stl"};
+
+static struct {
+	const char *name;
+	int (*func)(void);
+	int run;
+} suites[] = {
+	{"calib", bench_calibrate},
+	{"formats", bench_formats},
+	{"kernels", bench_kernels},
+	{"scaling", bench_scaling},
+	{0, 0}
+};
+
+static int parse_args(int argc, char **argv);
+static int parse_threads(const char *str);
+static int num_cpus(void);
+static void print_usage(const char *argv0);
+
+static const char *outfile, *basefile;
+static double tolerance = 20.0;
+static int json;
+
+int main(int argc, char **argv)
+{
+	int i, res = 0;
+	FILE *fp = stdout;
+
+	bopt.size = 1000000;
+	bopt.warmup = 1;
+	if(!(bopt.tmpdir = getenv("TMPDIR"))) {
+		bopt.tmpdir = "/tmp";
+	}
+
+	if(parse_args(argc, argv) == -1) {
+		return 1;
+	}
+
+	for(i=0; suites[i].name; i++) {
+		if(suites[i].run && suites[i].func() == -1) {
+			fprintf(stderr, "benchmark suite %s failed\n", suites[i].name);
+			res = 1;
+		}
+	}
+
+	if(outfile && !(fp = fopen(outfile, "wb"))) {
+		fprintf(stderr, "failed to open %s for writing\n", outfile);
+		bench_free_results();
+		return 1;
+	}
+	if(json) {
+		bench_write_json(fp);
+	} else {
+		bench_write_csv(fp);
+	}
+	if(fp != stdout) {
+		fclose(fp);
+	}
+
+	if(basefile && bench_compare(basefile, tolerance) != 0) {
+		res = 1;
+	}
+	bench_free_results();
+	return res;
+}
+
+static int parse_args(int argc, char **argv)
+{
+	int i, j, ncpu, nsuites = 0;
+	char *endp;
+
+	for(i=1; i<argc; i++) {
+		if(argv[i][0] == '-') {
+			if(argv[i][2] != 0) {
+				goto inval;
+			}
+			switch(argv[i][1]) {
+			case 's':
+				if(!argv[++i] || (bopt.size = strtol(argv[i], &endp, 10)) <= 0) {
+					fprintf(stderr, "-s must be followed by the number of triangles\n");
+					return -1;
+				}
+				if(*endp == 'k' || *endp == 'K') {
+					bopt.size *= 1000;
+				} else if(*endp == 'm' || *endp == 'M') {
+					bopt.size *= 1000000;
+				}
+				break;
+
+			case 'n':
+				if(!argv[++i] || (bopt.iter = atoi(argv[i])) <= 0) {
+					fprintf(stderr, "-n must be followed by the number of iterations\n");
+					return -1;
+				}
+				break;
+
+			case 'f':
+				if(!argv[++i]) {
+					fprintf(stderr, "-f must be followed by a file format id\n");
+					return -1;
+				}
+				for(j=1; j<MF_NUM_FMT; j++) {
+					if(strcmp(argv[i], fmtname[j]) == 0) {
+						bopt.fmtmask |= 1 << j;
+						break;
+					}
+				}
+				if(j >= MF_NUM_FMT) {
+					fprintf(stderr, "unknown file format: %s\n", argv[i]);
+					return -1;
+				}
+				break;
+
+			case 'w':
+				if(!argv[++i] || (bopt.warmup = atoi(argv[i])) < 0) {
+					fprintf(stderr, "-w must be followed by the number of warm-up iterations\n");
+					return -1;
+				}
+				break;
+
+			case 't':
+				if(parse_threads(argv[++i]) == -1) {
+					fprintf(stderr, "-t must be followed by a comma-separated list of thread counts\n");
+					return -1;
+				}
+				break;
+
+			case 'o':
+				if(!(outfile = argv[++i])) {
+					fprintf(stderr, "-o must be followed by a filename\n");
+					return -1;
+				}
+				break;
+
+			case 'j':
+				json = 1;
+				break;
+
+			case 'c':
+				if(!(basefile = argv[++i])) {
+					fprintf(stderr, "-c must be followed by a baseline CSV file\n");
+					return -1;
+				}
+				break;
+
+			case 'T':
+				if(!argv[++i] || (tolerance = strtod(argv[i], &endp)) < 0.0 || endp == argv[i]) {
+					fprintf(stderr, "-T must be followed by a tolerance in percent\n");
+					return -1;
+				}
+				break;
+
+			case 'd':
+				if(!(bopt.tmpdir = argv[++i])) {
+					fprintf(stderr, "-d must be followed by a directory\n");
+					return -1;
+				}
+				break;
+
+			case 'k':
+				bopt.keep = 1;
+				break;
+
+			case 'u':
+				bopt.cputime = 1;
+				break;
+
+			case 'h':
+				print_usage(argv[0]);
+				exit(0);
+
+			default:
+				goto inval;
+			}
+
+		} else {
+			for(j=0; suites[j].name; j++) {
+				if(strcmp(argv[i], suites[j].name) == 0) {
+					suites[j].run = 1;
+					nsuites++;
+					break;
+				}
+			}
+			if(!suites[j].name) {
+				fprintf(stderr, "unknown benchmark suite: %s\n", argv[i]);
+				return -1;
+			}
+		}
+	}
+
+	if(!nsuites) {
+		for(i=0; suites[i].name; i++) {
+			suites[i].run = 1;
+		}
+	}
+	if(!bopt.fmtmask) {
+		bopt.fmtmask = ~0;
+	}
+	if(!bopt.num_threads) {
+		/* powers of two up to the number of processors */
+		ncpu = num_cpus();
+		for(j=1; j<ncpu; j*=2) {
+			bopt.threads[bopt.num_threads++] = j;
+		}
+		bopt.threads[bopt.num_threads++] = ncpu;
+	}
+	return 0;
+
+inval:
+	fprintf(stderr, "invalid option: %s. See -h for usage\n", argv[i]);
+	return -1;
+}
+
+static int parse_threads(const char *str)
+{
+	int n;
+	char *endp;
+
+	if(!str) return -1;
+
+	bopt.num_threads = 0;
+	while(*str) {
+		if((n = strtol(str, &endp, 10)) <= 0 || endp == str) {
+			return -1;
+		}
+		if(bopt.num_threads >= sizeof bopt.threads / sizeof *bopt.threads) {
+			fprintf(stderr, "too many thread counts, ignoring: %s\n", str);
+			break;
+		}
+		bopt.threads[bopt.num_threads++] = n;
+		str = *endp == ',' ? endp + 1 : endp;
+	}
+	return bopt.num_threads > 0 ? 0 : -1;
+}
+
+static int num_cpus(void)
+{
+#if defined(_SC_NPROCESSORS_ONLN)
+	return sysconf(_SC_NPROCESSORS_ONLN);
+#else
+	return 1;
+#endif
+}
+
+static void print_usage(const char *argv0)
+{
+	int i;
+
+	printf("Usage: %s [options] [suite ...]\n", argv0);
+	printf("Options:\n");
+	printf(" -s <n>: number of triangles in the test scene, k/m suffix allowed (default: 1m)\n");
+	printf(" -n <n>: timed iterations per stage (default: 3 for formats, up to 11 for kernels)\n");
+	printf(" -w <n>: untimed warm-up iterations before each stage (default: 1)\n");
+	printf(" -t <n,...>: thread counts for the kernel and scaling benchmarks (default: powers\n");
+	printf("     of two up to the number of processors)\n");
+	printf(" -f <fmt>: only run the format benchmarks for fmt (can be repeated)\n");
+	printf(" -o <file>: write results to file instead of stdout\n");
+	printf(" -j: write results as JSON instead of CSV\n");
+	printf(" -c <file>: compare median times against a baseline CSV file, and exit with\n");
+	printf("     an error if any of them regressed\n");
+	printf(" -T <pct>: regression tolerance in percent for -c (default: 20)\n");
+	printf(" -d <dir>: directory for temporary files (default: $TMPDIR or /tmp)\n");
+	printf(" -k: keep temporary files\n");
+	printf(" -u: measure process CPU time instead of wall-clock time. Less sensitive to other\n");
+	printf("     load on the machine, but only meaningful single-threaded, and leaves out\n");
+	printf("     time spent waiting for I/O\n");
+	printf(" -h: print usage and exit\n");
+	printf("Benchmark suites (default: all):");
+	for(i=0; suites[i].name; i++) {
+		printf(" %s", suites[i].name);
+	}
+	putchar('\n');
+}
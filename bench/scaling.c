@@ -0,0 +1,264 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+#define DEF_ITER	3
+#define MIN_FILES	8
+#define FLAT_EFF	0.5		/* flag thread counts below 50% parallel efficiency */
+#define FLAT_GAIN	1.1		/* ... or gaining less than 10% over the previous count */
+
+enum { OP_ASYNC_LOAD, OP_ASYNC_SAVE, OP_BATCH_LOAD };
+
+/* the operations which can use more than one thread */
+static struct {
+	const char *name;
+	int op;
+	unsigned int flags;
+} ops[] = {
+	{"async_load", OP_ASYNC_LOAD, MF_NOPROC},
+	{"async_load_tangents", OP_ASYNC_LOAD, MF_GEN_TANGENTS},
+	{"async_save", OP_ASYNC_SAVE, 0},
+	{"batch_load", OP_BATCH_LOAD, MF_NOPROC},
+	{0}
+};
+
+static const int fmtlist[] = {MF_FMT_OBJ, MF_FMT_JTF, MF_FMT_STL, 0};
+static const char *fmtname[] = {0, "obj", "jtf", "gltf", "3ds", "stl"};
+
+static int prep_op(int op, struct mf_meshfile **mf, const char *path, int nfiles);
+static int run_op(int op, unsigned int flags, int fmt, struct mf_meshfile **mf,
+		const char **paths, int nfiles);
+static void end_op(struct mf_meshfile **mf, int nfiles);
+static void report(struct bench_result *res, int num);
+
+
+int bench_scaling(void)
+{
+	int i, j, k, n, fmt, iter, nfiles, maxthr, res = -1;
+	long ntris;
+	char **paths = 0;
+	double t0, *times = 0;
+	struct mf_meshfile *scene = 0, **mf = 0;
+	struct bench_result *results = 0, *br;
+
+	iter = bopt.iter > 0 ? bopt.iter : DEF_ITER;
+
+	maxthr = 1;
+	for(i=0; i<bopt.num_threads; i++) {
+		if(bopt.threads[i] > maxthr) maxthr = bopt.threads[i];
+	}
+	/* split the scene into enough files to keep every thread busy */
+	nfiles = maxthr * 2 > MIN_FILES ? maxthr * 2 : MIN_FILES;
+	ntris = bopt.size / nfiles;
+
+	fprintf(stderr, "generating %d synthetic scenes (%ld triangles each) ...\n", nfiles, ntris);
+	if(!(scene = bench_gen_scene(&ntris))) {
+		return -1;
+	}
+	if(!(mf = calloc(nfiles, sizeof *mf)) || !(paths = calloc(nfiles, sizeof *paths)) ||
+			!(times = malloc(iter * sizeof *times)) ||
+			!(results = calloc(bopt.num_threads, sizeof *results))) {
+		goto end;
+	}
+	for(i=0; i<nfiles; i++) {
+		if(!(paths[i] = malloc(strlen(bopt.tmpdir) + 32))) {
+			goto end;
+		}
+	}
+
+	for(i=0; (fmt = fmtlist[i]); i++) {
+		if(!(bopt.fmtmask & (1 << fmt))) continue;
+
+		for(j=0; j<nfiles; j++) {
+			sprintf(paths[j], "%s/mfscale%03d.%s", bopt.tmpdir, j, fmtname[fmt]);
+			if(mf_save(scene, paths[j], fmt) == -1) {
+				fprintf(stderr, "failed to save %s\n", paths[j]);
+				goto end;
+			}
+		}
+
+		for(j=0; ops[j].name; j++) {
+			for(k=0; k<bopt.num_threads; k++) {
+				br = results + k;
+				memset(br, 0, sizeof *br);
+				br->suite = "scaling";
+				br->name = ops[j].name;
+				br->stage = fmtname[fmt];
+				br->size = ntris * nfiles;
+				br->threads = bopt.threads[k];
+
+				if(mf_set_num_threads(bopt.threads[k]) == -1) {
+					br->fail = 1;
+					continue;
+				}
+				bench_reset_peak();
+				for(n=-bopt.warmup; n<iter; n++) {
+					if(prep_op(ops[j].op, mf, paths[0], nfiles) == -1) {
+						br->fail = 1;
+						break;
+					}
+					t0 = bench_time();
+					if(run_op(ops[j].op, ops[j].flags, fmt, mf, (const char**)paths, nfiles) == -1) {
+						br->fail = 1;
+					}
+					if(n >= 0) {
+						times[n] = bench_time() - t0;
+					}
+					end_op(mf, nfiles);
+					if(br->fail) break;
+				}
+				if(!br->fail) {
+					bench_stats(br, times, n);
+					br->rss_kb = bench_peak_rss();
+				}
+			}
+			report(results, bopt.num_threads);
+		}
+
+		if(!bopt.keep) {
+			for(j=0; j<nfiles; j++) {
+				remove(paths[j]);
+			}
+		}
+	}
+	res = 0;
+
+end:
+	mf_set_num_threads(0);
+	if(paths) {
+		for(i=0; i<nfiles; i++) {
+			free(paths[i]);
+		}
+		free(paths);
+	}
+	free(mf);
+	free(times);
+	free(results);
+	mf_free(scene);
+	return res;
+}
+
+/* allocate meshfiles to load into, or clones of the scene in path to save */
+static int prep_op(int op, struct mf_meshfile **mf, const char *path, int nfiles)
+{
+	int i;
+	struct mf_meshfile *scene = 0;
+
+	if(op == OP_ASYNC_SAVE) {
+		if(!(scene = mf_alloc()) || mf_load(scene, path, MF_NOPROC) == -1) {
+			goto err;
+		}
+	}
+	for(i=0; i<nfiles; i++) {
+		if(!(mf[i] = scene ? mf_clone_meshfile(scene) : mf_alloc())) {
+			goto err;
+		}
+	}
+	mf_free(scene);
+	return 0;
+
+err:
+	mf_free(scene);
+	end_op(mf, nfiles);
+	return -1;
+}
+
+static int run_op(int op, unsigned int flags, int fmt, struct mf_meshfile **mf,
+		const char **paths, int nfiles)
+{
+	int i, res = 0;
+	struct mf_async **aop;
+
+	if(op == OP_BATCH_LOAD) {
+		return mf_load_batch(mf, paths, nfiles, flags, 0) < nfiles ? -1 : 0;
+	}
+
+	if(!(aop = calloc(nfiles, sizeof *aop))) {
+		return -1;
+	}
+	for(i=0; i<nfiles; i++) {
+		if(op == OP_ASYNC_SAVE) {
+			aop[i] = mf_save_async(mf[i], paths[i], fmt, 0, 0);
+		} else {
+			aop[i] = mf_load_async(mf[i], paths[i], flags, 0, 0);
+		}
+	}
+	for(i=0; i<nfiles; i++) {
+		if(!aop[i] || mf_wait(aop[i]) == -1) {
+			res = -1;
+		}
+	}
+	free(aop);
+	return res;
+}
+
+static void end_op(struct mf_meshfile **mf, int nfiles)
+{
+	int i;
+
+	for(i=0; i<nfiles; i++) {
+		mf_free(mf[i]);
+		mf[i] = 0;
+	}
+}
+
+static void report(struct bench_result *res, int num)
+{
+	int i, base = -1;
+	double base_time;
+
+	for(i=0; i<num; i++) {
+		if(!res[i].fail && (base < 0 || res[i].threads < res[base].threads)) {
+			base = i;
+		}
+	}
+	if(base >= 0) {
+		/* assume linear scaling up to the smallest thread count we ran */
+		base_time = res[base].med * res[base].threads;
+
+		for(i=0; i<num; i++) {
+			if(res[i].fail || res[i].med <= 0.0) continue;
+			res[i].speedup = base_time / res[i].med;
+			res[i].eff = res[i].speedup / res[i].threads;
+			if(i != base && (res[i].eff < FLAT_EFF ||
+					(i > 0 && !res[i - 1].fail &&
+					 res[i].speedup < res[i - 1].speedup * FLAT_GAIN))) {
+				res[i].flat = 1;
+			}
+		}
+	}
+
+	for(i=0; i<num; i++) {
+		bench_add_result(res + i);
+	}
+
+	fprintf(stderr, "\n%s %s (%ld triangles)\n", res->name, res->stage, res->size);
+	fprintf(stderr, " threads   median time   speedup  efficiency\n");
+	for(i=0; i<num; i++) {
+		if(res[i].fail) {
+			fprintf(stderr, " %7d   FAILED\n", res[i].threads);
+		} else {
+			fprintf(stderr, " %7d  %9.3f ms  %8.2f  %9.1f%%%s\n", res[i].threads,
+					res[i].med * 1000.0, res[i].speedup, res[i].eff * 100.0,
+					res[i].flat ? "  <- scaling flattens" : "");
+		}
+	}
+	fputc('\n', stderr);
+}
@@ -0,0 +1,368 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "bench.h"
+
+static struct bench_result *results;
+static int num_results, max_results;
+
+
+double bench_time(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+#ifdef CLOCK_PROCESS_CPUTIME_ID
+	if(bopt.cputime && clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) == 0) {
+		return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+	}
+#endif
+	if(clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+		return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+	}
+#endif
+	{
+		struct timeval tv;
+		gettimeofday(&tv, 0);
+		return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+	}
+}
+
+/* On Linux the peak RSS (VmHWM) can be reset by writing 5 to clear_refs, which
+ * lets us report the peak of each stage separately. Elsewhere we're stuck with
+ * the peak of the whole process so far.
+ */
+void bench_reset_peak(void)
+{
+	FILE *fp;
+
+	if((fp = fopen("/proc/self/clear_refs", "w"))) {
+		fputs("5\n", fp);
+		fclose(fp);
+	}
+}
+
+long bench_peak_rss(void)
+{
+	FILE *fp;
+	char buf[128];
+	long kb = -1;
+	struct rusage ru;
+
+	if((fp = fopen("/proc/self/status", "r"))) {
+		while(fgets(buf, sizeof buf, fp)) {
+			if(memcmp(buf, "VmHWM:", 6) == 0) {
+				kb = atol(buf + 6);
+				break;
+			}
+		}
+		fclose(fp);
+	}
+	if(kb < 0 && getrusage(RUSAGE_SELF, &ru) == 0) {
+		kb = ru.ru_maxrss;
+#ifdef __APPLE__
+		kb /= 1024;		/* bytes on macOS */
+#endif
+	}
+	return kb;
+}
+
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(double*)a;
+	double y = *(double*)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+void bench_stats(struct bench_result *res, double *times, int n)
+{
+	int p90idx;
+
+	res->iter = n;
+	if(n <= 0) {
+		res->sec = res->med = res->p90 = 0.0;
+		return;
+	}
+	qsort(times, n, sizeof *times, cmp_double);
+
+	res->sec = times[0];
+	if(n & 1) {
+		res->med = times[n / 2];
+	} else {
+		res->med = (times[n / 2 - 1] + times[n / 2]) * 0.5;
+	}
+	p90idx = (n * 9 + 9) / 10 - 1;	/* nearest rank */
+	res->p90 = times[p90idx];
+}
+
+int bench_add_result(const struct bench_result *res)
+{
+	void *tmp;
+	int newsz;
+
+	if(num_results >= max_results) {
+		newsz = max_results ? max_results * 2 : 32;
+		if(!(tmp = realloc(results, newsz * sizeof *results))) {
+			fprintf(stderr, "failed to allocate result\n");
+			return -1;
+		}
+		results = tmp;
+		max_results = newsz;
+	}
+	results[num_results++] = *res;
+
+	fprintf(stderr, "%-8s %-10s %-8s %2dt %9ld tris %9.3f ms (med %9.3f)", res->suite,
+			res->name, res->stage, res->threads, res->size, res->sec * 1000.0,
+			res->med * 1000.0);
+	if(res->fail) {
+		fprintf(stderr, "  FAILED\n");
+	} else {
+		if(res->mbytes > 0.0) {
+			fprintf(stderr, " %9.2f MB/s", res->mbytes / res->sec);
+		}
+		fprintf(stderr, " %8.2f Mtris/s  %7ld KB peak\n", res->size / res->sec / 1e6,
+				res->rss_kb);
+	}
+	return 0;
+}
+
+void bench_free_results(void)
+{
+	free(results);
+	results = 0;
+	num_results = max_results = 0;
+}
+
+static double rate(const struct bench_result *res, double x)
+{
+	return !res->fail && res->sec > 0.0 ? x / res->sec : 0.0;
+}
+
+static const char *status(const struct bench_result *res)
+{
+	if(res->fail) return "fail";
+	return res->flat ? "flat" : "ok";
+}
+
+void bench_write_csv(FILE *fp)
+{
+	int i;
+	struct bench_result *res;
+
+	fputs("suite,name,stage,size,threads,iter,time,median,p90,mb_per_sec,tris_per_sec,peak_rss_kb,"
+			"speedup,efficiency,status\n", fp);
+	for(i=0; i<num_results; i++) {
+		res = results + i;
+		fprintf(fp, "%s,%s,%s,%ld,%d,%d,%.6f,%.6f,%.6f,%.3f,%.0f,%ld,%.3f,%.3f,%s\n",
+				res->suite, res->name, res->stage, res->size, res->threads, res->iter,
+				res->sec, res->med, res->p90, rate(res, res->mbytes), rate(res, res->size),
+				res->rss_kb, res->speedup, res->eff, status(res));
+	}
+}
+
+void bench_write_json(FILE *fp)
+{
+	int i;
+	struct bench_result *res;
+
+	fprintf(fp, "{\n\t\"triangles\": %ld,\n", bopt.size);
+	fputs("\t\"results\": [\n", fp);
+	for(i=0; i<num_results; i++) {
+		res = results + i;
+		fprintf(fp, "\t\t{\"suite\": \"%s\", \"name\": \"%s\", \"stage\": \"%s\", ",
+				res->suite, res->name, res->stage);
+		fprintf(fp, "\"size\": %ld, \"threads\": %d, \"iter\": %d, ", res->size, res->threads,
+				res->iter);
+		fprintf(fp, "\"time\": %.6f, \"median\": %.6f, \"p90\": %.6f, ", res->sec, res->med,
+				res->p90);
+		fprintf(fp, "\"mb_per_sec\": %.3f, \"tris_per_sec\": %.0f, \"peak_rss_kb\": %ld, ",
+				rate(res, res->mbytes), rate(res, res->size), res->rss_kb);
+		fprintf(fp, "\"speedup\": %.3f, \"efficiency\": %.3f, ", res->speedup, res->eff);
+		fprintf(fp, "\"status\": \"%s\"}%s\n", status(res), i < num_results - 1 ? "," : "");
+	}
+	fputs("\t]\n}\n", fp);
+}
+
+/* stages quicker than this are mostly timer and scheduling noise, and aren't
+ * checked for regressions, whatever the tolerance
+ */
+#define MIN_TIME	0.005
+
+enum { COL_SUITE, COL_NAME, COL_STAGE, COL_SIZE, COL_THREADS, COL_MEDIAN, COL_STATUS, NUM_COLS };
+static const char *colname[] = {"suite", "name", "stage", "size", "threads", "median", "status"};
+
+static int split_csv(char *line, char **fields, int maxfields)
+{
+	int n = 0;
+	char *end;
+
+	if((end = strpbrk(line, "\r\n"))) {
+		*end = 0;
+	}
+	while(n < maxfields) {
+		fields[n++] = line;
+		if(!(line = strchr(line, ','))) break;
+		*line++ = 0;
+	}
+	return n;
+}
+
+static struct bench_result *find_result(char **fields, const int *col)
+{
+	int i;
+	struct bench_result *res;
+
+	for(i=0; i<num_results; i++) {
+		res = results + i;
+		if(strcmp(res->suite, fields[col[COL_SUITE]]) == 0 &&
+				strcmp(res->name, fields[col[COL_NAME]]) == 0 &&
+				strcmp(res->stage, fields[col[COL_STAGE]]) == 0 &&
+				res->size == atol(fields[col[COL_SIZE]]) &&
+				res->threads == atoi(fields[col[COL_THREADS]])) {
+			return res;
+		}
+	}
+	return 0;
+}
+
+/* reads the next baseline line which has all the columns we need */
+static int next_line(FILE *fp, char *buf, int size, char **fields, int maxcol)
+{
+	int n;
+
+	while(fgets(buf, size, fp)) {
+		if((n = split_csv(buf, fields, 32)) > maxcol) {
+			return n;
+		}
+	}
+	return -1;
+}
+
+int bench_compare(const char *fname, double tol)
+{
+	FILE *fp;
+	char buf[512], *fields[32];
+	int i, j, n, col[NUM_COLS], maxcol = 0;
+	int num_cmp = 0, num_regr = 0, num_missing = 0, num_short = 0;
+	long start;
+	double base, cur, scale = 1.0;
+	struct bench_result *res;
+
+	if(!(fp = fopen(fname, "rb"))) {
+		fprintf(stderr, "failed to open baseline: %s\n", fname);
+		return -1;
+	}
+	if(!fgets(buf, sizeof buf, fp)) {
+		fprintf(stderr, "%s: empty baseline\n", fname);
+		goto err;
+	}
+	n = split_csv(buf, fields, sizeof fields / sizeof *fields);
+	for(i=0; i<NUM_COLS; i++) {
+		for(j=0; j<n; j++) {
+			if(strcmp(fields[j], colname[i]) == 0) break;
+		}
+		if(j >= n) {
+			fprintf(stderr, "%s: baseline has no %s column\n", fname, colname[i]);
+			goto err;
+		}
+		col[i] = j;
+		if(j > maxcol) maxcol = j;
+	}
+	start = ftell(fp);
+
+	/* scale the baseline by how much slower the calibration workload runs now.
+	 * Never scale it down: a quick calibration run on a noisy machine shouldn't
+	 * turn into false regressions.
+	 */
+	while(next_line(fp, buf, sizeof buf, fields, maxcol) != -1) {
+		if(strcmp(fields[col[COL_SUITE]], "calib") == 0) {
+			if((res = find_result(fields, col)) && !res->fail &&
+					(base = atof(fields[col[COL_MEDIAN]])) > 0.0) {
+				scale = res->med / base;
+				if(scale < 1.0) scale = 1.0;
+			}
+			break;
+		}
+	}
+	fseek(fp, start, SEEK_SET);
+
+	fprintf(stderr, "comparing against %s (tolerance: %g%%, ", fname, tol);
+	if(scale > 1.0) {
+		fprintf(stderr, "calibration: %.3fx the baseline time)\n", scale);
+	} else {
+		fprintf(stderr, "no calibration scaling)\n");
+	}
+
+	while(next_line(fp, buf, sizeof buf, fields, maxcol) != -1) {
+		if(strcmp(fields[col[COL_SUITE]], "calib") == 0) {
+			continue;
+		}
+		/* nothing to compare against if it didn't work when the baseline was taken */
+		if(strcmp(fields[col[COL_STATUS]], "fail") == 0) {
+			continue;
+		}
+		if(!(res = find_result(fields, col))) {
+			num_missing++;
+			continue;
+		}
+
+		if(res->fail) {
+			fprintf(stderr, "REGRESSION: %s %s %s %dt %ld tris: failed\n", res->suite,
+					res->name, res->stage, res->threads, res->size);
+			num_cmp++;
+			num_regr++;
+			continue;
+		}
+		base = atof(fields[col[COL_MEDIAN]]) * scale;
+		if(base < MIN_TIME) {
+			num_short++;
+			continue;
+		}
+		num_cmp++;
+
+		cur = res->med;
+		if(cur > base * (1.0 + tol / 100.0)) {
+			fprintf(stderr, "REGRESSION: %s %s %s %dt %ld tris: %.3f ms -> %.3f ms (%+.1f%%)\n",
+					res->suite, res->name, res->stage, res->threads, res->size,
+					base * 1000.0, cur * 1000.0, (cur / base - 1.0) * 100.0);
+			num_regr++;
+		}
+	}
+	fclose(fp);
+
+	if(num_missing) {
+		fprintf(stderr, "%d baseline results were not measured in this run\n", num_missing);
+	}
+	if(num_short) {
+		fprintf(stderr, "%d results under %g ms were not checked\n", num_short, MIN_TIME * 1000.0);
+	}
+	if(!num_cmp) {
+		fprintf(stderr, "no results matched the baseline, check the benchmark options\n");
+		return -1;
+	}
+	fprintf(stderr, "%d of %d results regressed by more than %g%%\n", num_regr, num_cmp, tol);
+	return num_regr;
+
+err:
+	fclose(fp);
+	return -1;
+}
@@ -0,0 +1,17 @@
+# Generated by: ./configure 
+PREFIX = /usr/local
+libdir = lib
+src = src/async.c src/batch.c src/bufio.c src/dedup.c src/dynarr.c src/fmt3ds.c src/fmtgltf.c src/fmtjtf.c src/fmtobj.c src/fmtstl.c src/gzip.c src/iouring.c src/json.c src/meshfile.c src/mtlcache.c src/nameidx.c src/rbtree.c src/thrpool.c src/trace.c src/util.c
+
+opt = -O3
+dbg = -g
+warn = -pedantic -Wall -Wno-pointer-to-int-cast -Wno-int-to-pointer-cast
+depgen = -MMD
+
+thr_libs = -lpthread
+iou_cflags = -DMF_IO_URING
+ldname = libmeshfile.so
+soname = $(ldname).$(somajor)
+libso = $(ldname).$(somajor).$(sominor)
+shared = -shared -Wl,-soname,$(soname)
+pic = -fPIC
@@ -81,6 +81,16 @@ struct mf_material {
 	void *udata;
 };
 
+/* dirty flags, set by the functions which modify meshes and nodes. Derived data
+ * (global matrices and bounding boxes) are recomputed lazily by mf_bounds, only
+ * for the parts of the scene which have changed.
+ */
+enum {
+	MF_DIRTY_GEOM	= 0x01,		/* mesh vertex positions changed */
+	MF_DIRTY_BOUNDS	= 0x02,		/* mesh or node bounding box out of date */
+	MF_DIRTY_XFORM	= 0x04		/* node matrix changed */
+};
+
 struct mf_node {
 	char *name;
 	struct mf_node *parent;
@@ -94,8 +104,13 @@ struct mf_node {
 	int num_meshes;
 
 	void *udata;
+
+	mf_aabox aabox;		/* world space bounds of the node's meshes */
+	unsigned int dirty;
 };
 
+struct mf_immed;
+
 struct mf_mesh {
 	char *name;
 	mf_vec3 *vertex;
@@ -111,10 +126,24 @@ struct mf_mesh {
 	struct mf_material *mtl;
 
 	void *udata;
+
+	unsigned int dirty;
+	struct mf_immed *immed;		/* mf_begin/mf_end state */
 };
 
 enum { MF_SEEK_SET, MF_SEEK_CUR, MF_SEEK_END };
 
+struct mf_iovec {
+	const void *base;
+	int len;
+};
+
+/* user I/O callbacks for mf_load_userio and mf_save_userio. When loading, the
+ * read and seek callbacks of the file passed in may be called from a background
+ * read-ahead thread, as well as from the thread which called mf_load_userio, so
+ * they must not rely on thread local state. They are called one at a time,
+ * never concurrently, and not after mf_load_userio returns.
+ */
 struct mf_userio {
 	void *file;
 	void *(*open)(const char*, const char*);
@@ -124,10 +153,17 @@ struct mf_userio {
 	long (*seek)(void*, long, int);
 };
 
+/* optional: write a number of buffers in one call (like POSIX writev) to the
+ * file of a user I/O, returning the number of bytes written, or -1 on error.
+ * See mf_set_writev.
+ */
+typedef int (*mf_writev_func)(void*, const struct mf_iovec*, int);
+
 /* load flags */
 enum {
 	MF_APPLY_XFORM		= 0x0001,	/* pre-transform to world space */
 	MF_GEN_TANGENTS		= 0x0002,	/* compute tangents if missing */
+	MF_STATS			= 0x0004,	/* collect statistics, see mf_load_stats */
 
 	MF_NOPROC			= 0x8000	/* don't perform any processing on load */
 };
@@ -143,14 +179,97 @@ enum {
 	MF_NUM_FMT
 };
 
+/* other save flags. Compression is also enabled by a .gz suffix in mf_save,
+ * and compressed files are detected automatically on load.
+ */
+enum {
+	MF_GZIP			= 0x0100	/* gzip compressed output */
+};
+
 struct mf_meshfile;
 
+/* statistics of a load performed with the MF_STATS flag. Times are in seconds.
+ * Reading from the file is done by a background thread while the loader is
+ * parsing, so read time overlaps parse time. Files loaded by mf_load_batch are
+ * read beforehand, and their read time is not included.
+ */
+struct mf_load_stats {
+	int fmt;				/* format of the file (MF_FMT_*) */
+
+	double probe;			/* loaders which didn't recognize the file */
+	double read;			/* reading from the underlying file */
+	double parse;			/* the loader which succeeded, minus dedup */
+	double dedup;			/* merging identical vertices (OBJ) */
+	double normals;
+	double tangents;
+	double xform;			/* node matrices, and MF_APPLY_XFORM */
+	double bounds;
+	double total;
+
+	unsigned long bytes_read;	/* compressed size for gzipped files */
+	unsigned int num_meshes, num_materials, num_nodes;
+	unsigned long num_verts, num_faces;
+	unsigned long num_allocs;	/* array allocations and reallocations */
+	unsigned long mem_peak;		/* peak memory allocated by the load, see mf_mem_stats */
+};
+
+/* memory accounting categories */
+enum {
+	MF_MEM_ATTR,		/* vertex attribute arrays */
+	MF_MEM_FACES,		/* face index arrays */
+	MF_MEM_NAMES,		/* object and texture names, and the name index */
+	MF_MEM_RBTREE,		/* search tree nodes */
+	MF_MEM_DEDUP,		/* OBJ vertex deduplication keys */
+	MF_MEM_JSON,		/* glTF JSON document tree */
+	MF_MEM_OTHER,		/* scene objects, loader arrays and buffers */
+	MF_NUM_MEMCAT
+};
+
+/* used is the memory taken up by the contents of the meshfile, computed when
+ * mf_mem_stats is called. Arrays shared by cloned meshes are counted for each
+ * mesh. peak is the highest amount of memory allocated in each category by
+ * the last load done with MF_STATS, and peak_total the highest sum, which
+ * includes transient data like the JSON tree and dedup tables. Only
+ * allocations made by the loading thread through the library's arrays, trees,
+ * JSON parser, name pool and file buffers are counted.
+ */
+struct mf_mem_stats {
+	unsigned long used[MF_NUM_MEMCAT], used_total;
+	unsigned long peak[MF_NUM_MEMCAT], peak_total;
+};
+
+/* progress stages */
+enum {
+	MF_STAGE_READ,		/* done/total: bytes of the file read (compressed for .gz) */
+	MF_STAGE_NORMALS,	/* done/total: meshes processed */
+	MF_STAGE_TANGENTS,
+	MF_STAGE_XFORM,
+	MF_STAGE_WRITE		/* done: bytes written, total is unknown. Not reported for MF_GZIP */
+};
+
+/* progress callback for loads and saves. Called about once per megabyte read
+ * or written, and once per mesh during post-processing, from the thread doing
+ * the load or save. total is -1 when unknown. Returning nonzero cancels the
+ * operation, which then fails with -1, like mf_cancel.
+ */
+typedef int (*mf_progress_func)(int stage, long done, long total, void *cls);
+
 struct mf_meshfile *mf_alloc(void);
 void mf_free(struct mf_meshfile *mf);
 int mf_init(struct mf_meshfile *mf);
 void mf_destroy(struct mf_meshfile *mf);
 void mf_clear(struct mf_meshfile *mf);
 
+/* Cloning is cheap: mesh vertex attributes and faces are reference counted, and
+ * only copied when a clone (or the original) is modified by a library call.
+ * Modifying the arrays of a cloned mesh directly requires calling
+ * mf_unshare_mesh first, to make sure the mesh has its own copy.
+ * mf_clone_meshfile deep-copies everything else.
+ */
+struct mf_meshfile *mf_clone_meshfile(const struct mf_meshfile *mf);
+struct mf_mesh *mf_clone_mesh(const struct mf_mesh *m);
+int mf_unshare_mesh(struct mf_mesh *m);
+
 struct mf_mesh *mf_alloc_mesh(void);
 void mf_free_mesh(struct mf_mesh *m);
 int mf_init_mesh(struct mf_mesh *m);
@@ -178,6 +297,10 @@ struct mf_material *mf_get_material(const struct mf_meshfile *mf, int idx);
 struct mf_node *mf_get_node(const struct mf_meshfile *mf, int idx);
 struct mf_node *mf_get_topnode(const struct mf_meshfile *mf, int idx);
 
+/* lookups by name go through an index built by the mf_add_* functions. If more
+ * than one object has the same name, the first one added is returned. Objects
+ * must be named before they are added to the meshfile.
+ */
 struct mf_mesh *mf_find_mesh(const struct mf_meshfile *mf, const char *name);
 struct mf_material *mf_find_material(const struct mf_meshfile *mf, const char *name);
 struct mf_node *mf_find_node(const struct mf_meshfile *mf, const char *name);
@@ -186,16 +309,110 @@ int mf_add_mesh(struct mf_meshfile *mf, struct mf_mesh *m);
 int mf_add_material(struct mf_meshfile *mf, struct mf_material *mtl);
 int mf_add_node(struct mf_meshfile *mf, struct mf_node *n);
 
+/* mf_bounds brings global matrices and bounding boxes up to date, as needed */
 int mf_bounds(const struct mf_meshfile *mf, mf_aabox *bb);
+
+/* find meshes with identical geometry and material, and replace them with a
+ * single mesh, referenced by all the nodes which referenced any of them.
+ * Returns the number of meshes removed, or -1 on failure.
+ */
+int mf_dedup_meshes(struct mf_meshfile *mf);
 void mf_update_xform(struct mf_meshfile *mf);
 int mf_apply_xform(struct mf_meshfile *mf);
 
 int mf_load(struct mf_meshfile *mf, const char *fname, unsigned int flags);
+/* see struct mf_userio about which thread calls the I/O callbacks */
 int mf_load_userio(struct mf_meshfile *mf, const struct mf_userio *io, unsigned int flags);
+/* returns -1 if the last load wasn't done with MF_STATS */
+int mf_load_stats(const struct mf_meshfile *mf, struct mf_load_stats *st);
+int mf_mem_stats(const struct mf_meshfile *mf, struct mf_mem_stats *ms);
+
+/* memory budget for subsequent loads into mf, in bytes (0 for no limit, the
+ * default). Loaders check it before large allocations and while growing
+ * arrays, and a load that would exceed it fails. Returns -1 if the build
+ * doesn't support memory accounting.
+ */
+int mf_set_mem_limit(struct mf_meshfile *mf, unsigned long bytes);
+unsigned long mf_get_mem_limit(const struct mf_meshfile *mf);
+
+/* set a progress callback for loads into, and saves from mf (null to disable) */
+void mf_set_progress(struct mf_meshfile *mf, mf_progress_func func, void *cls);
+
+/* set a writev callback for mf_save_userio, used to write large blocks together
+ * with any buffered data in one call. It's called with the file of the user I/O
+ * passed to mf_save_userio (or opened through its open callback), so it must
+ * match those callbacks. Null (the default) disables it.
+ */
+void mf_set_writev(struct mf_meshfile *mf, mf_writev_func func);
 
 int mf_save(const struct mf_meshfile *mf, const char *fname, unsigned int flags);
 int mf_save_userio(const struct mf_meshfile *mf, const struct mf_userio *io, unsigned int flags);
 
+/* load a number of files in one go. On Linux, reads for multiple files are kept
+ * in flight at once through io_uring, and each file is parsed from memory while
+ * the next ones are still being read. If res is not null, it receives the
+ * result of each individual load (0 or -1). Returns the number of files loaded
+ * successfully.
+ */
+int mf_load_batch(struct mf_meshfile **mf, const char **fnames, int count, unsigned int flags,
+		int *res);
+
+/* asynchronous load/save, performed by the meshfile worker threads. The
+ * meshfile must not be accessed until the operation completes. The optional
+ * callback is called from the worker thread when the operation is done, or
+ * from the calling thread before mf_load_async/mf_save_async return, if the
+ * operation couldn't be handed over to a worker.
+ * mf_poll returns non-zero if the operation has completed. mf_wait blocks until
+ * completion and until the callback has returned, releases the async handle,
+ * and returns the result (0 or -1). mf_wait must be called exactly once for
+ * every async operation, even after mf_cancel, and not from its own callback:
+ * the handle stays valid until then, and the callback may poll it.
+ */
+struct mf_async;
+typedef void (*mf_async_func)(struct mf_async *op, int res, void *cls);
+
+struct mf_async *mf_load_async(struct mf_meshfile *mf, const char *fname, unsigned int flags,
+		mf_async_func done, void *cls);
+struct mf_async *mf_save_async(const struct mf_meshfile *mf, const char *fname, unsigned int flags,
+		mf_async_func done, void *cls);
+int mf_poll(struct mf_async *op);
+int mf_wait(struct mf_async *op);
+void mf_cancel(struct mf_async *op);
+
+/* number of worker threads for asynchronous operations. 0 (the default) starts
+ * one per processor. Operations already queued are completed by the previous
+ * threads; don't call this while other threads are starting async operations.
+ * mf_get_num_threads returns 0 if the library was built without threads.
+ */
+int mf_set_num_threads(int num);
+int mf_get_num_threads(void);
+
+/* timeline tracing of the library internals (loaders, writers, processing and
+ * worker threads), in the Chrome trace event format, which can be viewed in
+ * chrome://tracing or Perfetto. Only available if the library was built with
+ * tracing enabled (configure --enable-trace), otherwise the start functions
+ * return -1. mf_trace_start writes a JSON array of events to io, which is
+ * completed by mf_trace_stop. Alternatively mf_trace_callback calls func as
+ * each span ends, with the start time and duration in seconds, on the same
+ * clock as CLOCK_MONOTONIC, and a small sequential id of the calling thread.
+ * Calls to func are serialized. Only one trace can be active at a time.
+ */
+typedef void (*mf_trace_func)(const char *name, const char *detail, double start, double dur,
+		int tid, void *cls);
+
+int mf_trace_start(const struct mf_userio *io);
+int mf_trace_callback(mf_trace_func func, void *cls);
+void mf_trace_stop(void);
+
+/* shared cache of parsed OBJ material libraries, across all meshfiles. When
+ * enabled, each material library file is parsed once, and subsequent loads
+ * which reference it get copies of the cached materials, as long as the file
+ * has not been modified. Disabled by default. Disabling the cache or calling
+ * mf_flush_mtl_cache releases all cached materials.
+ */
+void mf_mtl_cache(int enable);
+void mf_flush_mtl_cache(void);
+
 /* mesh functions */
 void mf_clear_mesh(struct mf_mesh *m);
 
@@ -207,9 +424,17 @@ int mf_add_color(struct mf_mesh *m, float r, float g, float b, float a);
 int mf_add_triangle(struct mf_mesh *m, int a, int b, int c);
 int mf_add_quad(struct mf_mesh *m, int a, int b, int c, int d);
 
+/* immediate mode mesh building. mf_begin_hint takes the expected number of
+ * vertices, to allocate space up front. mf_vertices adds a batch of vertices,
+ * with 3 floats per position, normal, 2 per texture coordinate, and 4 per
+ * color. Attribute arrays may be null to use the current value instead.
+ */
 int mf_begin(struct mf_mesh *m, enum mf_primitive prim);
+int mf_begin_hint(struct mf_mesh *m, enum mf_primitive prim, int num_verts);
 void mf_end(struct mf_mesh *m);
 int mf_vertex(struct mf_mesh *m, float x, float y, float z);
+int mf_vertices(struct mf_mesh *m, int count, const float *pos, const float *norm,
+		const float *uv, const float *col);
 void mf_normal(struct mf_mesh *m, float x, float y, float z);
 void mf_tangent(struct mf_mesh *m, float x, float y, float z);
 void mf_texcoord(struct mf_mesh *m, float u, float v);
@@ -220,18 +445,35 @@ void mf_tangentv(struct mf_mesh *m, float *v);
 void mf_texcooordv(struct mf_mesh *m, float *v);
 void mf_colorv(struct mf_mesh *m, float *v);
 
+/* hash of all vertex attributes and faces of a mesh */
+unsigned int mf_hash_mesh(const struct mf_mesh *m);
+
 int mf_calc_normals(struct mf_mesh *m);
 int mf_calc_tangents(struct mf_mesh *m);
 void mf_transform_mesh(struct mf_mesh *m, const float *mat);
+/* call after modifying vertex positions directly */
+void mf_invalidate_mesh(struct mf_mesh *m);
 
 /* node functions */
 int mf_node_add_mesh(struct mf_node *n, struct mf_mesh *m);
 int mf_node_remove_mesh(struct mf_node *n, struct mf_mesh *m);
 int mf_node_add_child(struct mf_node *n, struct mf_node *c);
 int mf_node_remove_child(struct mf_node *n, struct mf_node *c);
+void mf_node_set_matrix(struct mf_node *n, const float *mat);
 void mf_node_update_xform(struct mf_node *n);
 
 /* utility functions */
+
+/* asset paths are searched for textures and other external files, after the
+ * directory of the file being loaded. mf_find_asset returns the path where an
+ * asset was found, or fname if it can't be found. mf_resolve_assets replaces
+ * all texture map names with the paths they resolve to, and returns the number
+ * of textures which could not be found. Lookups are cached until the meshfile
+ * is cleared, or the asset paths change.
+ */
+int mf_add_asset_path(struct mf_meshfile *mf, const char *dir);
+void mf_clear_asset_paths(struct mf_meshfile *mf);
 const char *mf_find_asset(const struct mf_meshfile *mf, const char *fname);
+int mf_resolve_assets(struct mf_meshfile *mf);
 
 #endif	/* MESHFILE_H_ */
@@ -0,0 +1,207 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mfpriv.h"
+#include "thrpool.h"
+#include "trace.h"
+
+enum { OP_LOAD, OP_SAVE };
+
+struct mf_async {
+	int op;
+	struct mf_meshfile *mf;
+	char *fname;
+	unsigned int flags;
+
+	mf_async_func done_func;
+	void *done_cls;
+
+	volatile int cancel;
+	int done, res;
+	int in_callback;	/* done, but the completion callback is still running */
+
+#ifndef MF_NO_THREADS
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+#endif
+};
+
+#ifdef MF_TLS
+MF_TLS volatile int *mf_cur_cancel;
+static MF_TLS struct mf_async *cur_callback_op;
+#endif
+
+static struct mf_async *start_op(int op, struct mf_meshfile *mf, const char *fname,
+		unsigned int flags, mf_async_func done, void *cls);
+static void async_job(void *cls);
+
+
+struct mf_async *mf_load_async(struct mf_meshfile *mf, const char *fname, unsigned int flags,
+		mf_async_func done, void *cls)
+{
+	return start_op(OP_LOAD, mf, fname, flags, done, cls);
+}
+
+struct mf_async *mf_save_async(const struct mf_meshfile *mf, const char *fname, unsigned int flags,
+		mf_async_func done, void *cls)
+{
+	return start_op(OP_SAVE, (struct mf_meshfile*)mf, fname, flags, done, cls);
+}
+
+int mf_poll(struct mf_async *op)
+{
+	int done;
+#ifndef MF_NO_THREADS
+	pthread_mutex_lock(&op->lock);
+	done = op->done;
+	pthread_mutex_unlock(&op->lock);
+#else
+	done = op->done;
+#endif
+	return done;
+}
+
+int mf_wait(struct mf_async *op)
+{
+	int res;
+
+#ifdef MF_TLS
+	if(op == cur_callback_op) {
+		fprintf(stderr, "mf_wait: can't wait for an async operation from its own callback\n");
+		return -1;
+	}
+#endif
+
+#ifndef MF_NO_THREADS
+	pthread_mutex_lock(&op->lock);
+	while(!op->done || op->in_callback) {
+		pthread_cond_wait(&op->cond, &op->lock);
+	}
+	pthread_mutex_unlock(&op->lock);
+
+	pthread_mutex_destroy(&op->lock);
+	pthread_cond_destroy(&op->cond);
+#endif
+
+	res = op->res;
+	free(op->fname);
+	free(op);
+	return res;
+}
+
+void mf_cancel(struct mf_async *op)
+{
+	op->cancel = 1;
+}
+
+static struct mf_async *start_op(int op, struct mf_meshfile *mf, const char *fname,
+		unsigned int flags, mf_async_func done, void *cls)
+{
+	struct mf_async *aop;
+	struct mf_thrpool *tpool;
+
+	if(!(aop = calloc(1, sizeof *aop))) {
+		fprintf(stderr, "mf_%s_async: failed to allocate async operation\n",
+				op == OP_LOAD ? "load" : "save");
+		return 0;
+	}
+	if(!(aop->fname = strdup(fname))) {
+		fprintf(stderr, "mf_%s_async: failed to allocate file name\n",
+				op == OP_LOAD ? "load" : "save");
+		free(aop);
+		return 0;
+	}
+	aop->op = op;
+	aop->mf = mf;
+	aop->flags = flags;
+	aop->done_func = done;
+	aop->done_cls = cls;
+
+#ifndef MF_NO_THREADS
+	pthread_mutex_init(&aop->lock, 0);
+	pthread_cond_init(&aop->cond, 0);
+#endif
+
+	/* if we can't hand it over to the worker threads, just do it now */
+	if(!(tpool = mf_worker_pool()) || mf_tpool_enqueue(tpool, async_job, aop) == -1) {
+		async_job(aop);
+	}
+	return aop;
+}
+
+static void async_job(void *cls)
+{
+	struct mf_async *aop = cls;
+	struct mf_meshfile *mf = aop->mf;
+	int res;
+	double tspan;
+
+	if(aop->cancel) {
+		res = -1;
+	} else {
+		TRACE_BEGIN(tspan);
+#ifdef MF_TLS
+		mf_cur_cancel = &aop->cancel;
+#endif
+		if(aop->op == OP_LOAD) {
+			res = mf_load(mf, aop->fname, aop->flags);
+		} else {
+			res = mf_save(mf, aop->fname, aop->flags);
+		}
+#ifdef MF_TLS
+		mf_cur_cancel = 0;
+#endif
+		TRACE_END_ARG(tspan, aop->op == OP_LOAD ? "async_load" : "async_save", aop->fname);
+	}
+
+	/* mark it done before calling back, so that the callback can poll it. mf_wait
+	 * holds off releasing the handle until the callback returns, and this may
+	 * still run before start_op has returned the handle, so the callback can't
+	 * be the one to release it.
+	 */
+#ifndef MF_NO_THREADS
+	pthread_mutex_lock(&aop->lock);
+	aop->res = res;
+	aop->done = 1;
+	aop->in_callback = aop->done_func != 0;
+	pthread_cond_broadcast(&aop->cond);
+	pthread_mutex_unlock(&aop->lock);
+#else
+	aop->res = res;
+	aop->done = 1;
+#endif
+
+	if(aop->done_func) {
+#ifdef MF_TLS
+		cur_callback_op = aop;
+#endif
+		aop->done_func(aop, res, aop->done_cls);
+#ifdef MF_TLS
+		cur_callback_op = 0;
+#endif
+
+#ifndef MF_NO_THREADS
+		pthread_mutex_lock(&aop->lock);
+		aop->in_callback = 0;
+		pthread_cond_broadcast(&aop->cond);
+		pthread_mutex_unlock(&aop->lock);
+#endif
+	}
+}
@@ -0,0 +1,321 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mfpriv.h"
+#include "iouring.h"
+#include "trace.h"
+
+#ifdef MF_IO_URING
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define RING_DEPTH	64
+#define CHUNK_SIZE	(1 << 20)
+#define MAX_AHEAD	(64 << 20)	/* max bytes read ahead of the file being parsed */
+
+struct bfile {
+	const char *fname;
+	int fd;
+	unsigned char *buf;
+	long size;
+	unsigned long memlimit;	/* memory budget of the meshfile it's loaded into */
+	int nreq;		/* outstanding reads */
+	int err;
+};
+
+struct request {
+	struct bfile *bf;
+	long offs;
+	unsigned int sz;
+	struct request *next;
+};
+
+struct batch {
+	struct mf_ioring *ring;
+	struct request *rqhead, *rqtail;	/* reads waiting for a submission slot */
+	long ahead;
+};
+
+static int start_file(struct batch *b, struct bfile *bf);
+static int add_request(struct batch *b, struct bfile *bf, long offs, unsigned int sz);
+static void drop_file(struct batch *b, struct bfile *bf);
+static void complete(struct batch *b, struct request *rq, int res);
+static void close_ring(struct batch *b);
+static void end_file(struct batch *b, struct bfile *bf);
+#endif
+
+
+int mf_load_batch(struct mf_meshfile **mf, const char **fnames, int count, unsigned int flags,
+		int *res)
+{
+	int i, r, num_loaded = 0;
+#ifdef MF_IO_URING
+	int next;
+	struct batch b;
+	struct bfile *files;
+	struct request *rq;
+	double tspan;
+
+	memset(&b, 0, sizeof b);
+	if(count <= 0 || !(b.ring = mf_ioring_create(RING_DEPTH))) {
+		goto fallback;
+	}
+	if(!(files = calloc(count, sizeof *files))) {
+		mf_ioring_destroy(b.ring);
+		goto fallback;
+	}
+	for(i=0; i<count; i++) {
+		files[i].fd = -1;
+	}
+
+	next = 0;
+	for(i=0; i<count; i++) {
+		/* keep reading ahead while the current file is parsed */
+		while(b.ring && next < count && (next == i || b.ahead < MAX_AHEAD)) {
+			files[next].fname = fnames[next];
+			files[next].memlimit = mf_get_mem_limit(mf[next]);
+			start_file(&b, files + next++);
+		}
+
+		TRACE_BEGIN(tspan);
+		while(b.ring && files[i].nreq > 0) {
+			while(b.rqhead && mf_ioring_space(b.ring) > 0) {
+				rq = b.rqhead;
+				if(mf_ioring_read(b.ring, rq->bf->fd, rq->bf->buf + rq->offs, rq->sz,
+							rq->offs, rq) == -1) {
+					break;
+				}
+				b.rqhead = rq->next;
+			}
+			mf_ioring_submit(b.ring);
+
+			if(mf_ioring_pending(b.ring) <= 0 || !(rq = mf_ioring_wait(b.ring, &r))) {
+				/* the rest of the files are loaded the regular way */
+				fprintf(stderr, "mf_load_batch: io_uring reads failed, falling back to mf_load\n");
+				close_ring(&b);
+				break;
+			}
+			complete(&b, rq, r);
+		}
+		TRACE_END_ARG(tspan, "batch_wait", fnames[i]);
+
+		if(files[i].err) {
+			r = -1;
+		} else if(!b.ring || files[i].fd == -1) {
+			r = mf_load(mf[i], fnames[i], flags);
+		} else {
+			r = mf_load_buffer(mf[i], fnames[i], files[i].buf, files[i].size, flags);
+		}
+		end_file(&b, files + i);
+
+		if(res) res[i] = r;
+		if(r != -1) num_loaded++;
+	}
+
+	close_ring(&b);
+	for(i=0; i<next; i++) {
+		end_file(&b, files + i);
+	}
+	free(files);
+	return num_loaded;
+
+fallback:
+#endif	/* MF_IO_URING */
+
+	for(i=0; i<count; i++) {
+		r = mf_load(mf[i], fnames[i], flags);
+		if(res) res[i] = r;
+		if(r != -1) num_loaded++;
+	}
+	return num_loaded;
+}
+
+#ifdef MF_IO_URING
+static int start_file(struct batch *b, struct bfile *bf)
+{
+	struct stat st;
+	long offs, sz;
+
+	if((bf->fd = open(bf->fname, O_RDONLY)) == -1) {
+		fprintf(stderr, "mf_load_batch: failed to open: %s: %s\n", bf->fname, strerror(errno));
+		bf->err = 1;
+		return -1;
+	}
+	if(fstat(bf->fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size > INT_MAX ||
+			(bf->memlimit && (unsigned long)st.st_size > bf->memlimit)) {
+		/* leave anything we can't read in one go, or that would blow the memory
+		 * budget if we did, to mf_load
+		 */
+		close(bf->fd);
+		bf->fd = -1;
+		return 0;
+	}
+	bf->size = st.st_size;
+
+	/* mf_load needs less memory than reading it whole, so if we can't set up
+	 * the reads, fall back to that instead of failing the file
+	 */
+	if(!(bf->buf = malloc(bf->size + 1))) {
+		drop_file(b, bf);
+		return 0;
+	}
+	b->ahead += bf->size;
+
+	for(offs=0; offs<bf->size; offs+=CHUNK_SIZE) {
+		sz = bf->size - offs;
+		if(sz > CHUNK_SIZE) sz = CHUNK_SIZE;
+		if(add_request(b, bf, offs, sz) == -1) {
+			drop_file(b, bf);
+			return 0;
+		}
+	}
+	return 0;
+}
+
+static int add_request(struct batch *b, struct bfile *bf, long offs, unsigned int sz)
+{
+	struct request *rq;
+
+	if(!(rq = malloc(sizeof *rq))) {
+		fprintf(stderr, "mf_load_batch: failed to allocate read request\n");
+		return -1;
+	}
+	rq->bf = bf;
+	rq->offs = offs;
+	rq->sz = sz;
+	rq->next = 0;
+
+	if(b->rqhead) {
+		b->rqtail->next = rq;
+	} else {
+		b->rqhead = rq;
+	}
+	b->rqtail = rq;
+	bf->nreq++;
+	return 0;
+}
+
+/* leave a file to mf_load, before any of its reads have been submitted */
+static void drop_file(struct batch *b, struct bfile *bf)
+{
+	struct request *rq, *prev = 0, *next;
+
+	for(rq=b->rqhead; rq; rq=next) {
+		next = rq->next;
+		if(rq->bf != bf) {
+			prev = rq;
+			continue;
+		}
+		if(prev) {
+			prev->next = next;
+		} else {
+			b->rqhead = next;
+		}
+		if(b->rqtail == rq) {
+			b->rqtail = prev;
+		}
+		bf->nreq--;
+		free(rq);
+	}
+
+	if(bf->buf) {
+		b->ahead -= bf->size;
+		free(bf->buf);
+		bf->buf = 0;
+	}
+	close(bf->fd);
+	bf->fd = -1;
+}
+
+static void complete(struct batch *b, struct request *rq, int res)
+{
+	struct bfile *bf = rq->bf;
+
+	if(res == -EINVAL || res == -EOPNOTSUPP) {
+		/* kernel too old for IORING_OP_READ, do this one with a plain pread */
+		if((res = pread(bf->fd, bf->buf + rq->offs, rq->sz, rq->offs)) == -1) {
+			res = -errno;
+		}
+	}
+
+	if(res < 0) {
+		fprintf(stderr, "mf_load_batch: read failed: %s: %s\n", bf->fname, strerror(-res));
+		bf->err = 1;
+	} else if(res == 0) {
+		fprintf(stderr, "mf_load_batch: unexpected EOF: %s\n", bf->fname);
+		bf->err = 1;
+	} else if((unsigned int)res < rq->sz) {
+		/* short read, queue up the rest */
+		if(add_request(b, bf, rq->offs + res, rq->sz - res) == -1) {
+			bf->err = 1;
+		}
+	}
+
+	bf->nreq--;
+	free(rq);
+}
+
+/* Closing the ring doesn't stop reads already handed to the kernel, which carry
+ * on writing into the file buffers. Reap them all first, and if that fails,
+ * leave the buffers they're reading into allocated, for end_file to leak.
+ */
+static void close_ring(struct batch *b)
+{
+	int res;
+	struct request *rq;
+
+	if(!b->ring) return;
+
+	while(b->rqhead) {
+		rq = b->rqhead;
+		b->rqhead = rq->next;
+		rq->bf->nreq--;
+		free(rq);
+	}
+
+	while(mf_ioring_pending(b->ring) > 0) {
+		if(!(rq = mf_ioring_wait(b->ring, &res))) {
+			fprintf(stderr, "mf_load_batch: failed to wait for outstanding reads\n");
+			break;
+		}
+		rq->bf->nreq--;
+		free(rq);
+	}
+
+	mf_ioring_destroy(b->ring);
+	b->ring = 0;
+}
+
+static void end_file(struct batch *b, struct bfile *bf)
+{
+	if(bf->buf && bf->nreq <= 0) {
+		b->ahead -= bf->size;
+		free(bf->buf);
+		bf->buf = 0;
+	}
+	if(bf->fd != -1) {
+		close(bf->fd);
+		bf->fd = -1;
+	}
+}
+#endif	/* MF_IO_URING */
@@ -0,0 +1,823 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bufio.h"
+#include "mfpriv.h"
+#include "gzip.h"
+#include "util.h"
+#include "trace.h"
+
+#ifndef MF_NO_THREADS
+#include <pthread.h>
+#endif
+
+#define BLKSIZE		65536
+#define PROG_INTERVAL	(1 << 20)
+
+enum { BLK_EMPTY, BLK_PENDING, BLK_FULL };
+
+struct block {
+	unsigned char *data;
+	long fpos;		/* file offset of the first byte in the block */
+	int size;		/* number of valid bytes */
+	int state;
+};
+
+struct rdbuf {
+	struct mf_userio io;	/* underlying I/O callbacks */
+	long iopos;				/* current position of the underlying file */
+	long filesz;
+
+	/* blk[cur] is being consumed, blk[cur ^ 1] is the next one */
+	struct block blk[2];
+	int cur, rdpos;
+
+	int readahead;
+	int membuf;		/* reading from a memory buffer, no underlying file */
+
+	struct mf_load_stats *stats;	/* accumulates time and bytes read, if set */
+
+	mf_bufio_progress_func progress;
+	void *progcls;
+	long prognext;
+	int stop;		/* the progress callback asked to stop reading */
+#ifndef MF_NO_THREADS
+	pthread_t thr;
+	int thr_running, quit;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+#endif
+};
+
+struct wrbuf {
+	struct mf_userio io;
+	mf_writev_func writev;
+	unsigned char *buf;
+	long bufpos;		/* file offset of buf[0], where the underlying file is */
+	int len, wrpos;
+	int err;
+
+	mf_bufio_progress_func progress;
+	void *progcls;
+	long prognext;
+};
+
+static void *rd_open(const char *fname, const char *mode);
+static void rd_close(void *file);
+static int rd_read(void *file, void *buf, int sz);
+static int rd_write(void *file, const void *buf, int sz);
+static long rd_seek(void *file, long offs, int from);
+
+static int wr_write(void *file, const void *buf, int sz);
+static long wr_seek(void *file, long offs, int from);
+
+static int rd_progress(struct rdbuf *rb);
+static int wr_progress(struct wrbuf *wb);
+
+static int next_block(struct rdbuf *rb);
+static void wait_block(struct rdbuf *rb, struct block *blk);
+static void request_block(struct rdbuf *rb, struct block *blk, long fpos);
+static void fill_block(struct rdbuf *rb, struct block *blk);
+static void set_state(struct rdbuf *rb, struct block *blk, int state);
+#ifndef MF_NO_THREADS
+static void *thread_func(void *arg);
+#endif
+
+static int flush(struct wrbuf *wb);
+static int write_through(struct wrbuf *wb, const void *data, int sz);
+static int write_all(const struct mf_userio *io, const void *data, int sz);
+
+
+int mf_bufio_rdopen(struct mf_userio *bio, const struct mf_userio *io, int readahead)
+{
+	int i;
+	struct rdbuf *rb;
+
+	if(!(rb = calloc(1, sizeof *rb))) {
+		return -1;
+	}
+	for(i=0; i<2; i++) {
+		if(!(rb->blk[i].data = malloc(BLKSIZE))) {
+			free(rb->blk[0].data);
+			free(rb);
+			return -1;
+		}
+	}
+	MF_MEM_ACCT(MF_MEM_OTHER, 2 * BLKSIZE);
+	rb->io = *io;
+	if((rb->iopos = io->seek(io->file, 0, MF_SEEK_CUR)) == -1) {
+		rb->iopos = 0;
+	}
+	rb->filesz = -1;
+	rb->blk[0].fpos = rb->iopos;
+#ifndef MF_NO_THREADS
+	rb->readahead = readahead;
+	pthread_mutex_init(&rb->lock, 0);
+	pthread_cond_init(&rb->cond, 0);
+#endif
+
+	bio->file = rb;
+	bio->open = io->open ? rd_open : 0;
+	bio->close = rd_close;
+	bio->read = rd_read;
+	bio->write = rd_write;
+	bio->seek = rd_seek;
+	return 0;
+}
+
+int mf_bufio_memopen(struct mf_userio *bio, const struct mf_userio *io, void *buf, long size)
+{
+	struct rdbuf *rb;
+
+	if(!(rb = calloc(1, sizeof *rb))) {
+		return -1;
+	}
+	rb->io = *io;
+	rb->membuf = 1;
+	rb->filesz = size;
+	rb->blk[0].data = buf;
+	rb->blk[0].size = size;
+	rb->blk[0].state = BLK_FULL;
+#ifndef MF_NO_THREADS
+	pthread_mutex_init(&rb->lock, 0);
+	pthread_cond_init(&rb->cond, 0);
+#endif
+
+	bio->file = rb;
+	bio->open = io->open ? rd_open : 0;
+	bio->close = rd_close;
+	bio->read = rd_read;
+	bio->write = rd_write;
+	bio->seek = rd_seek;
+	return 0;
+}
+
+void mf_bufio_rdclose(struct mf_userio *bio)
+{
+	struct rdbuf *rb = bio->file;
+	struct block *blk;
+	long pos;
+
+	if(!rb) return;
+
+#ifndef MF_NO_THREADS
+	if(rb->thr_running) {
+		pthread_mutex_lock(&rb->lock);
+		rb->quit = 1;
+		pthread_cond_broadcast(&rb->cond);
+		pthread_mutex_unlock(&rb->lock);
+		pthread_join(rb->thr, 0);
+	}
+	pthread_mutex_destroy(&rb->lock);
+	pthread_cond_destroy(&rb->cond);
+#endif
+
+	if(rb->membuf) {
+		free(rb);
+		bio->file = 0;
+		return;
+	}
+
+	/* leave the underlying file where the caller would expect it */
+	blk = rb->blk + rb->cur;
+	pos = blk->fpos + (blk->state == BLK_FULL ? rb->rdpos : 0);
+	if(pos != rb->iopos) {
+		rb->io.seek(rb->io.file, pos, MF_SEEK_SET);
+	}
+
+	MF_MEM_ACCT(MF_MEM_OTHER, -2 * BLKSIZE);
+	free(rb->blk[0].data);
+	free(rb->blk[1].data);
+	free(rb);
+	bio->file = 0;
+}
+
+int mf_bufio_wropen(struct mf_userio *bio, const struct mf_userio *io, mf_writev_func writev)
+{
+	struct wrbuf *wb;
+
+	if(!(wb = calloc(1, sizeof *wb))) {
+		return -1;
+	}
+	if(!(wb->buf = malloc(BLKSIZE))) {
+		free(wb);
+		return -1;
+	}
+	wb->io = *io;
+	wb->writev = writev;
+	if((wb->bufpos = io->seek ? io->seek(io->file, 0, MF_SEEK_CUR) : 0) == -1) {
+		wb->bufpos = 0;
+	}
+
+	memset(bio, 0, sizeof *bio);
+	bio->file = wb;
+	bio->open = io->open ? rd_open : 0;
+	bio->close = rd_close;
+	bio->write = wr_write;
+	bio->seek = wr_seek;
+	return 0;
+}
+
+int mf_bufio_wrclose(struct mf_userio *bio)
+{
+	int res;
+	struct wrbuf *wb = bio->file;
+
+	if(!wb) return -1;
+
+	res = flush(wb) == -1 || wb->err ? -1 : 0;
+	free(wb->buf);
+	free(wb);
+	bio->file = 0;
+	return res;
+}
+
+void mf_bufio_stats(struct mf_userio *bio, struct mf_load_stats *st)
+{
+	((struct rdbuf*)bio->file)->stats = st;
+}
+
+void mf_bufio_progress(const struct mf_userio *bio, mf_bufio_progress_func func, void *cls)
+{
+	struct rdbuf *rb;
+	struct wrbuf *wb;
+
+	if(mf_is_bufio(bio)) {
+		rb = bio->file;
+		rb->progress = func;
+		rb->progcls = cls;
+		rb->prognext = 0;
+		rb->stop = 0;
+	} else if(bio->write == wr_write) {
+		wb = bio->file;
+		wb->progress = func;
+		wb->progcls = cls;
+		wb->prognext = PROG_INTERVAL;
+	}
+}
+
+int mf_is_bufio(const struct mf_userio *io)
+{
+	return io->read == rd_read;
+}
+
+char *mf_bufio_gets(char *buf, int sz, const struct mf_userio *bio)
+{
+	struct rdbuf *rb = bio->file;
+	struct block *blk;
+	unsigned char *src, *nl;
+	char *dest = buf;
+	int len, avail, room, found = 0;
+
+	if(rb->progress && rd_progress(rb) == -1) {
+		return 0;
+	}
+
+	while(!found) {
+		blk = rb->blk + rb->cur;
+		if(blk->state != BLK_FULL || rb->rdpos >= blk->size) {
+			if(next_block(rb) == -1) break;
+			continue;
+		}
+		src = blk->data + rb->rdpos;
+		avail = blk->size - rb->rdpos;
+		if((nl = memchr(src, '\n', avail))) {
+			len = nl - src + 1;
+			found = 1;
+		} else {
+			len = avail;
+		}
+
+		/* excess characters beyond the end of buf are dropped, like mf_fgets */
+		room = buf + sz - 1 - dest;
+		memcpy(dest, src, len < room ? len : room);
+		dest += len < room ? len : room;
+		rb->rdpos += len;
+	}
+
+	if(!found && dest == buf) {
+		return 0;
+	}
+	*dest = 0;
+	return buf;
+}
+
+const struct mf_userio *mf_base_userio(const struct mf_userio *io)
+{
+	const struct mf_userio *inner;
+
+	for(;;) {
+		if(mf_is_bufio(io)) {
+			io = &((struct rdbuf*)io->file)->io;
+		} else if(io->write == wr_write) {
+			io = &((struct wrbuf*)io->file)->io;
+		} else if((inner = mf_gzip_userio(io))) {
+			io = inner;
+		} else {
+			break;
+		}
+	}
+	return io;
+}
+
+int mf_subio_open(struct mf_userio *subio, const struct mf_userio *io, const char *fname,
+		const char *mode)
+{
+	struct mf_userio tmp;
+	const struct mf_userio *uio = mf_base_userio(io);
+	mf_writev_func writev = 0;
+
+	if(io->write == wr_write) {
+		writev = ((struct wrbuf*)io->file)->writev;
+	}
+	if(!uio->open) {
+		return -1;
+	}
+
+	tmp = *uio;
+	if(!(tmp.file = uio->open(fname, mode))) {
+		return -1;
+	}
+
+	if(mode[0] == 'r') {
+		if(mf_bufio_rdopen(subio, &tmp, 0) != -1) {
+			return 0;
+		}
+	} else {
+		if(mf_bufio_wropen(subio, &tmp, writev) != -1) {
+			return 0;
+		}
+	}
+	*subio = tmp;	/* fall back to unbuffered */
+	return 0;
+}
+
+void mf_subio_close(struct mf_userio *subio)
+{
+	struct mf_userio uio;
+
+	if(mf_is_bufio(subio)) {
+		uio = ((struct rdbuf*)subio->file)->io;
+		mf_bufio_rdclose(subio);
+	} else if(subio->write == wr_write) {
+		uio = ((struct wrbuf*)subio->file)->io;
+		mf_bufio_wrclose(subio);
+	} else {
+		uio = *subio;
+	}
+	uio.close(uio.file);
+}
+
+static void *rd_open(const char *fname, const char *mode)
+{
+	/* auxiliary files must be opened with mf_subio_open */
+	return 0;
+}
+
+static void rd_close(void *file)
+{
+}
+
+static int rd_read(void *file, void *buf, int sz)
+{
+	struct rdbuf *rb = file;
+	struct block *blk;
+	unsigned char *dest = buf;
+	int len, total = 0;
+
+	while(sz > 0) {
+		if(rb->progress && rd_progress(rb) == -1) {
+			break;
+		}
+		blk = rb->blk + rb->cur;
+		if(blk->state != BLK_FULL || rb->rdpos >= blk->size) {
+			if(next_block(rb) == -1) break;
+			continue;
+		}
+		len = blk->size - rb->rdpos;
+		if(len > sz) len = sz;
+		memcpy(dest, blk->data + rb->rdpos, len);
+		rb->rdpos += len;
+		dest += len;
+		sz -= len;
+		total += len;
+	}
+	return total > 0 ? total : -1;
+}
+
+static int rd_write(void *file, const void *buf, int sz)
+{
+	return -1;
+}
+
+static long rd_seek(void *file, long offs, int from)
+{
+	struct rdbuf *rb = file;
+	struct block *blk = rb->blk + rb->cur;
+	struct block *next = rb->blk + (rb->cur ^ 1);
+	long pos, curpos;
+
+	curpos = blk->fpos + (blk->state == BLK_FULL ? rb->rdpos : 0);
+
+	switch(from) {
+	case MF_SEEK_SET:
+		pos = offs;
+		break;
+	case MF_SEEK_CUR:
+		if(offs == 0) return curpos;
+		pos = curpos + offs;
+		break;
+	case MF_SEEK_END:
+		if(rb->filesz < 0) {
+			wait_block(rb, next);
+			rb->filesz = rb->io.seek(rb->io.file, 0, MF_SEEK_END);
+			rb->iopos = rb->filesz;
+			if(rb->filesz < 0) return -1;
+		}
+		pos = rb->filesz + offs;
+		break;
+	default:
+		return -1;
+	}
+	if(pos < 0) return -1;
+
+	if(rb->membuf) {
+		rb->rdpos = pos < blk->size ? pos : blk->size;
+		return pos;
+	}
+
+	/* seeking within the current block */
+	if(blk->state == BLK_FULL && pos >= blk->fpos && pos <= blk->fpos + blk->size) {
+		rb->rdpos = pos - blk->fpos;
+		return pos;
+	}
+
+	/* seeking into the block being read ahead */
+	wait_block(rb, next);
+	if(next->state == BLK_FULL && pos >= next->fpos && pos < next->fpos + next->size) {
+		if(next_block(rb) == -1) return -1;
+		rb->rdpos = pos - rb->blk[rb->cur].fpos;
+		return pos;
+	}
+
+	/* otherwise drop everything, and start reading from pos on the next read */
+	set_state(rb, blk, BLK_EMPTY);
+	set_state(rb, next, BLK_EMPTY);
+	blk->fpos = pos;
+	blk->size = 0;
+	rb->rdpos = 0;
+	return pos;
+}
+
+static int wr_write(void *file, const void *buf, int sz)
+{
+	struct wrbuf *wb = file;
+
+	if(wb->err) return -1;
+
+	if(wb->wrpos + sz > BLKSIZE) {
+		if(wb->progress && wr_progress(wb) == -1) {
+			return -1;
+		}
+		if(sz >= BLKSIZE && wb->wrpos == wb->len) {
+			return write_through(wb, buf, sz);
+		}
+		if(flush(wb) == -1) {
+			return -1;
+		}
+		if(sz >= BLKSIZE) {
+			return write_through(wb, buf, sz);
+		}
+	}
+
+	memcpy(wb->buf + wb->wrpos, buf, sz);
+	wb->wrpos += sz;
+	if(wb->wrpos > wb->len) {
+		wb->len = wb->wrpos;
+	}
+	return sz;
+}
+
+static long wr_seek(void *file, long offs, int from)
+{
+	struct wrbuf *wb = file;
+	long pos;
+
+	switch(from) {
+	case MF_SEEK_SET:
+		pos = offs;
+		break;
+	case MF_SEEK_CUR:
+		pos = wb->bufpos + wb->wrpos + offs;
+		if(offs == 0) return pos;
+		break;
+	case MF_SEEK_END:
+		if(!wb->io.seek || flush(wb) == -1) return -1;
+		if((pos = wb->io.seek(wb->io.file, offs, MF_SEEK_END)) != -1) {
+			wb->bufpos = pos;
+		}
+		return pos;
+	default:
+		return -1;
+	}
+	if(pos < 0) return -1;
+
+	/* moving around in the buffered range doesn't require flushing */
+	if(pos >= wb->bufpos && pos <= wb->bufpos + wb->len) {
+		wb->wrpos = pos - wb->bufpos;
+		return pos;
+	}
+
+	if(!wb->io.seek || flush(wb) == -1) return -1;
+	if((pos = wb->io.seek(wb->io.file, pos, MF_SEEK_SET)) != -1) {
+		wb->bufpos = pos;
+	}
+	return pos;
+}
+
+/* report the read position to the progress callback once every PROG_INTERVAL
+ * bytes, and stop reading if it returns nonzero.
+ */
+static int rd_progress(struct rdbuf *rb)
+{
+	long pos;
+
+	if(rb->stop) return -1;
+
+	pos = rb->blk[rb->cur].fpos + rb->rdpos;
+	if(pos >= rb->prognext) {
+		rb->prognext = pos + PROG_INTERVAL;
+		if(rb->progress(pos, rb->progcls)) {
+			rb->stop = 1;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* same for writes, called before each flush. Returning nonzero fails this and
+ * all further writes.
+ */
+static int wr_progress(struct wrbuf *wb)
+{
+	long pos = wb->bufpos + wb->wrpos;
+
+	if(pos >= wb->prognext) {
+		wb->prognext = pos + PROG_INTERVAL;
+		if(wb->progress(pos, wb->progcls)) {
+			wb->err = 1;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* makes the next block current, either by waiting for the read-ahead to
+ * complete, or by reading it synchronously. Returns -1 at EOF.
+ */
+static int next_block(struct rdbuf *rb)
+{
+	struct block *blk = rb->blk + rb->cur;
+	struct block *next = rb->blk + (rb->cur ^ 1);
+
+	if(rb->membuf) {
+		return -1;
+	}
+
+	if(blk->state != BLK_FULL) {
+		/* nothing has been read yet since the last reset */
+		fill_block(rb, blk);
+		set_state(rb, blk, BLK_FULL);
+		rb->rdpos = 0;
+	} else {
+		if(blk->size < BLKSIZE) {
+			return -1;	/* short block means we hit EOF */
+		}
+		if(next->state == BLK_EMPTY) {
+			next->fpos = blk->fpos + blk->size;
+			fill_block(rb, next);
+			set_state(rb, next, BLK_FULL);
+		} else {
+			wait_block(rb, next);
+		}
+		set_state(rb, blk, BLK_EMPTY);
+		rb->cur ^= 1;
+		rb->rdpos = 0;
+		blk = next;
+	}
+
+	if(blk->size <= 0) {
+		return -1;
+	}
+	if(blk->size == BLKSIZE) {
+		request_block(rb, rb->blk + (rb->cur ^ 1), blk->fpos + blk->size);
+	}
+	return 0;
+}
+
+static void wait_block(struct rdbuf *rb, struct block *blk)
+{
+#ifndef MF_NO_THREADS
+	if(!rb->thr_running) return;
+
+	pthread_mutex_lock(&rb->lock);
+	while(blk->state == BLK_PENDING) {
+		pthread_cond_wait(&rb->cond, &rb->lock);
+	}
+	pthread_mutex_unlock(&rb->lock);
+#endif
+}
+
+/* queue up the next block for the read-ahead thread. The thread is only
+ * started once the file turns out to be larger than a single block, to avoid
+ * the overhead for small files.
+ */
+static void request_block(struct rdbuf *rb, struct block *blk, long fpos)
+{
+#ifndef MF_NO_THREADS
+	if(!rb->readahead) return;
+
+	if(!rb->thr_running) {
+		if(pthread_create(&rb->thr, 0, thread_func, rb) != 0) {
+			rb->readahead = 0;
+			return;
+		}
+		rb->thr_running = 1;
+	}
+
+	pthread_mutex_lock(&rb->lock);
+	blk->fpos = fpos;
+	blk->state = BLK_PENDING;
+	pthread_cond_broadcast(&rb->cond);
+	pthread_mutex_unlock(&rb->lock);
+#endif
+}
+
+static void fill_block(struct rdbuf *rb, struct block *blk)
+{
+	int rd;
+	double t0 = 0, tspan;
+
+	if(rb->stats) t0 = mf_get_time();
+	TRACE_BEGIN(tspan);
+
+	blk->size = 0;
+	if(rb->iopos != blk->fpos) {
+		rb->iopos = rb->io.seek(rb->io.file, blk->fpos, MF_SEEK_SET);
+	}
+	if(rb->iopos == blk->fpos) {
+		while(blk->size < BLKSIZE) {
+			rd = rb->io.read(rb->io.file, blk->data + blk->size, BLKSIZE - blk->size);
+			if(rd <= 0) break;
+			blk->size += rd;
+		}
+		rb->iopos += blk->size;
+	}
+
+	if(rb->stats) {
+		rb->stats->read += mf_get_time() - t0;
+		rb->stats->bytes_read += blk->size;
+	}
+	TRACE_END(tspan, "read");
+}
+
+static void set_state(struct rdbuf *rb, struct block *blk, int state)
+{
+#ifndef MF_NO_THREADS
+	if(rb->thr_running) {
+		pthread_mutex_lock(&rb->lock);
+		blk->state = state;
+		pthread_mutex_unlock(&rb->lock);
+		return;
+	}
+#endif
+	blk->state = state;
+}
+
+#ifndef MF_NO_THREADS
+static void *thread_func(void *arg)
+{
+	int i;
+	struct rdbuf *rb = arg;
+	struct block *blk;
+
+	pthread_mutex_lock(&rb->lock);
+	for(;;) {
+		blk = 0;
+		for(i=0; i<2; i++) {
+			if(rb->blk[i].state == BLK_PENDING) {
+				blk = rb->blk + i;
+				break;
+			}
+		}
+		if(!blk) {
+			if(rb->quit) break;
+			pthread_cond_wait(&rb->cond, &rb->lock);
+			continue;
+		}
+
+		pthread_mutex_unlock(&rb->lock);
+		fill_block(rb, blk);
+		pthread_mutex_lock(&rb->lock);
+		blk->state = BLK_FULL;
+		pthread_cond_broadcast(&rb->cond);
+	}
+	pthread_mutex_unlock(&rb->lock);
+	return 0;
+}
+#endif
+
+static int flush(struct wrbuf *wb)
+{
+	if(wb->len > 0) {
+		if(write_all(&wb->io, wb->buf, wb->len) == -1) {
+			wb->err = 1;
+			return -1;
+		}
+		if(wb->wrpos != wb->len) {
+			/* we seeked back before flushing, go back there in the file too */
+			if(!wb->io.seek || wb->io.seek(wb->io.file, wb->bufpos + wb->wrpos, MF_SEEK_SET) == -1) {
+				wb->err = 1;
+				return -1;
+			}
+		}
+	}
+	wb->bufpos += wb->wrpos;
+	wb->len = wb->wrpos = 0;
+	return 0;
+}
+
+/* large writes bypass the buffer. If there's buffered data, and a writev
+ * callback is available, both are written in a single call.
+ */
+static int write_through(struct wrbuf *wb, const void *data, int sz)
+{
+	int wr;
+	struct mf_iovec iov[2];
+
+	if(wb->len > 0 && wb->writev) {
+		iov[0].base = wb->buf;
+		iov[0].len = wb->len;
+		iov[1].base = data;
+		iov[1].len = sz;
+		if((wr = wb->writev(wb->io.file, iov, 2)) == -1) {
+			wb->err = 1;
+			return -1;
+		}
+		/* write whatever's left over the slow way */
+		if(wr < wb->len) {
+			if(write_all(&wb->io, wb->buf + wr, wb->len - wr) == -1 ||
+					write_all(&wb->io, data, sz) == -1) {
+				wb->err = 1;
+				return -1;
+			}
+		} else if(wr < wb->len + sz) {
+			wr -= wb->len;
+			if(write_all(&wb->io, (const char*)data + wr, sz - wr) == -1) {
+				wb->err = 1;
+				return -1;
+			}
+		}
+		wb->bufpos += wb->len;
+		wb->len = wb->wrpos = 0;
+	} else {
+		if(flush(wb) == -1 || write_all(&wb->io, data, sz) == -1) {
+			wb->err = 1;
+			return -1;
+		}
+	}
+	wb->bufpos += sz;
+	return sz;
+}
+
+static int write_all(const struct mf_userio *io, const void *data, int sz)
+{
+	int wr;
+	const char *ptr = data;
+
+	while(sz > 0) {
+		if((wr = io->write(io->file, ptr, sz)) <= 0) {
+			return -1;
+		}
+		ptr += wr;
+		sz -= wr;
+	}
+	return 0;
+}
@@ -0,0 +1,81 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef BUFIO_H_
+#define BUFIO_H_
+
+#include "meshfile.h"
+
+/* Buffered reader layered on top of a set of user I/O callbacks. Data are read
+ * from the underlying file in large blocks, and with readahead enabled, a
+ * background thread fills the next block while the loader is parsing the
+ * current one. Seeking within the buffered range doesn't touch the underlying
+ * file at all.
+ *
+ * mf_bufio_rdopen initializes bio to read from the current position of the file
+ * in io. The original io must stay valid until mf_bufio_rdclose is called.
+ */
+int mf_bufio_rdopen(struct mf_userio *bio, const struct mf_userio *io, int readahead);
+void mf_bufio_rdclose(struct mf_userio *bio);
+
+/* same as above, but reading from a file which is already in memory. io is
+ * only used to open auxiliary files, and buf must stay valid until
+ * mf_bufio_rdclose.
+ */
+int mf_bufio_memopen(struct mf_userio *bio, const struct mf_userio *io, void *buf, long size);
+
+/* Write-combining buffer, for writers which issue lots of small writes. Seeking
+ * back within the buffered range (to patch chunk sizes for instance) is done in
+ * memory. Large writes are passed through, combined with any buffered data
+ * through the writev callback if not null. mf_bufio_wrclose flushes any
+ * remaining data, and returns -1 if any write failed.
+ */
+int mf_bufio_wropen(struct mf_userio *bio, const struct mf_userio *io, mf_writev_func writev);
+int mf_bufio_wrclose(struct mf_userio *bio);
+
+/* accumulate the time spent reading from the underlying file, and the number
+ * of bytes read, into st. Only valid for readers opened with mf_bufio_rdopen.
+ * With readahead, st is updated from the background thread until the reader is
+ * closed.
+ */
+void mf_bufio_stats(struct mf_userio *bio, struct mf_load_stats *st);
+
+/* call func with the current file position every megabyte or so read from, or
+ * written to a buffered reader or writer. It's called from the thread doing
+ * the reading or writing, never from the read-ahead thread. If func returns
+ * nonzero, all further reads or writes fail.
+ */
+typedef int (*mf_bufio_progress_func)(long pos, void *cls);
+void mf_bufio_progress(const struct mf_userio *bio, mf_bufio_progress_func func, void *cls);
+
+int mf_is_bufio(const struct mf_userio *io);
+
+/* fast path for mf_fgets on buffered readers */
+char *mf_bufio_gets(char *buf, int sz, const struct mf_userio *bio);
+
+/* the user I/O callbacks under any layers of buffering/compression */
+const struct mf_userio *mf_base_userio(const struct mf_userio *io);
+
+/* open an auxiliary file (mtl library, external glTF buffer, etc) through the
+ * same user I/O callbacks as io. The file is buffered for reading or writing
+ * depending on the mode.
+ */
+int mf_subio_open(struct mf_userio *subio, const struct mf_userio *io, const char *fname,
+		const char *mode);
+void mf_subio_close(struct mf_userio *subio);
+
+#endif	/* BUFIO_H_ */
@@ -0,0 +1,237 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "mfpriv.h"
+#include "dynarr.h"
+#include "trace.h"
+
+struct meshref {
+	uint32_t hash;
+	int idx;
+};
+
+static uint32_t hash_data(uint32_t hash, const void *data, unsigned long size);
+static int arrsize(void *da);
+static int same_mesh(const struct mf_mesh *a, const struct mf_mesh *b);
+static int cmp_meshref(const void *a, const void *b);
+static void fix_nameidx(struct mf_meshfile *mf, struct mf_mesh *dup, struct rbtree *repl);
+static void remove_dup_refs(struct mf_node *node);
+
+#define ROTL(x, s)	(((x) << (s)) | ((x) >> (32 - (s))))
+
+unsigned int mf_hash_mesh(const struct mf_mesh *m)
+{
+	uint32_t hash = m->num_verts * 0x9e3779b1u + m->num_faces;
+
+	hash = hash_data(hash, m->vertex, arrsize(m->vertex) * sizeof *m->vertex);
+	hash = hash_data(hash, m->normal, arrsize(m->normal) * sizeof *m->normal);
+	hash = hash_data(hash, m->tangent, arrsize(m->tangent) * sizeof *m->tangent);
+	hash = hash_data(hash, m->texcoord, arrsize(m->texcoord) * sizeof *m->texcoord);
+	hash = hash_data(hash, m->color, arrsize(m->color) * sizeof *m->color);
+	hash = hash_data(hash, m->faces, arrsize(m->faces) * sizeof *m->faces);
+	return hash;
+}
+
+int mf_dedup_meshes(struct mf_meshfile *mf)
+{
+	int i, j, k, num, ndup = 0;
+	struct meshref *refs;
+	struct mf_mesh *m, *dup;
+	struct mf_node *node;
+	struct rbtree *repl;
+	struct rbnode *rbn;
+	double tspan;
+
+	if((num = mf_dynarr_size(mf->meshes)) < 2) {
+		return 0;
+	}
+	TRACE_BEGIN(tspan);
+	if(!(refs = malloc(num * sizeof *refs))) {
+		return -1;
+	}
+	if(!(repl = rb_create(RB_KEY_ADDR))) {
+		free(refs);
+		return -1;
+	}
+
+	for(i=0; i<num; i++) {
+		refs[i].hash = mf_hash_mesh(mf->meshes[i]);
+		refs[i].idx = i;
+	}
+	/* sort by hash, and by index within each group, so that the first mesh in
+	 * each set of identical meshes is the one we keep
+	 */
+	qsort(refs, num, sizeof *refs, cmp_meshref);
+
+	for(i=0; i<num; i++) {
+		if(refs[i].idx < 0) continue;
+		m = mf->meshes[refs[i].idx];
+
+		for(j=i+1; j<num && refs[j].hash == refs[i].hash; j++) {
+			if(refs[j].idx < 0) continue;
+			dup = mf->meshes[refs[j].idx];
+			if(same_mesh(m, dup)) {
+				rb_insert(repl, dup, m);
+				refs[j].idx = -1;
+			}
+		}
+	}
+
+	if(rb_size(repl) > 0) {
+		/* point all node references to the meshes we keep */
+		num = mf_dynarr_size(mf->nodes);
+		for(i=0; i<num; i++) {
+			node = mf->nodes[i];
+			for(j=0; j<node->num_meshes; j++) {
+				if((rbn = rb_find(repl, node->meshes[j]))) {
+					node->meshes[j] = rbn->data;
+				}
+			}
+			remove_dup_refs(node);
+		}
+
+		num = mf_dynarr_size(mf->meshes);
+		for(i=0; i<num; i++) {
+			if(rb_find(repl, mf->meshes[i])) {
+				fix_nameidx(mf, mf->meshes[i], repl);
+			}
+		}
+
+		/* drop the duplicates, keeping the order of the rest */
+		for(i=0, k=0; i<num; i++) {
+			m = mf->meshes[i];
+			if(rb_find(repl, m)) {
+				mf_free_mesh(m);
+				ndup++;
+			} else {
+				mf->meshes[k++] = m;
+			}
+		}
+		while(mf_dynarr_size(mf->meshes) > k) {
+			mf->meshes = mf_dynarr_pop(mf->meshes);
+		}
+	}
+
+	rb_free(repl);
+	free(refs);
+	TRACE_END(tspan, "dedup_meshes");
+	return ndup;
+}
+
+/* 4 independent lanes over 16 byte blocks, which the compiler can keep in a
+ * single SIMD register, and a byte at a time for the tail.
+ */
+static uint32_t hash_data(uint32_t hash, const void *data, unsigned long size)
+{
+	int i;
+	uint32_t lane[4], w[4];
+	const unsigned char *ptr = data;
+
+	for(i=0; i<4; i++) {
+		lane[i] = hash + i * 0x85ebca6bu;
+	}
+
+	while(size >= 16) {
+		memcpy(w, ptr, 16);
+		for(i=0; i<4; i++) {
+			lane[i] = (lane[i] ^ w[i]) * 0x9e3779b1u;
+			lane[i] ^= lane[i] >> 15;
+		}
+		ptr += 16;
+		size -= 16;
+	}
+
+	hash = lane[0] ^ ROTL(lane[1], 7) ^ ROTL(lane[2], 13) ^ ROTL(lane[3], 19);
+	while(size-- > 0) {
+		hash = (hash ^ *ptr++) * 16777619u;
+	}
+	return hash ^ (hash >> 16);
+}
+
+static int arrsize(void *da)
+{
+	return da ? mf_dynarr_size(da) : 0;
+}
+
+#define SAME_ARR(a, b) \
+	(arrsize(a) == arrsize(b) && (!arrsize(a) || memcmp(a, b, arrsize(a) * sizeof *(a)) == 0))
+
+static int same_mesh(const struct mf_mesh *a, const struct mf_mesh *b)
+{
+	if(a->mtl != b->mtl || a->num_verts != b->num_verts || a->num_faces != b->num_faces) {
+		return 0;
+	}
+	return SAME_ARR(a->vertex, b->vertex) && SAME_ARR(a->normal, b->normal) &&
+		SAME_ARR(a->tangent, b->tangent) && SAME_ARR(a->texcoord, b->texcoord) &&
+		SAME_ARR(a->color, b->color) && SAME_ARR(a->faces, b->faces);
+}
+
+static int cmp_meshref(const void *a, const void *b)
+{
+	const struct meshref *ra = a;
+	const struct meshref *rb = b;
+
+	if(ra->hash != rb->hash) {
+		return ra->hash < rb->hash ? -1 : 1;
+	}
+	return ra->idx - rb->idx;
+}
+
+/* if the name index points to a mesh we're about to free, point it to the next
+ * mesh with the same name which we're keeping instead
+ */
+static void fix_nameidx(struct mf_meshfile *mf, struct mf_mesh *dup, struct rbtree *repl)
+{
+	int i, num;
+	struct mf_nameent *ent;
+
+	if(!(ent = mf_nameidx_find(mf->names, dup->name)) || ent->obj[MF_NAME_MESH] != dup) {
+		return;
+	}
+	ent->obj[MF_NAME_MESH] = 0;
+
+	num = mf_dynarr_size(mf->meshes);
+	for(i=0; i<num; i++) {
+		if(strcmp(mf->meshes[i]->name, dup->name) == 0 && !rb_find(repl, mf->meshes[i])) {
+			ent->obj[MF_NAME_MESH] = mf->meshes[i];
+			break;
+		}
+	}
+}
+
+/* a node which referenced more than one of a set of identical meshes, now
+ * references the same mesh multiple times
+ */
+static void remove_dup_refs(struct mf_node *node)
+{
+	int i, j, k;
+
+	for(i=1, k=1; i<node->num_meshes; i++) {
+		for(j=0; j<k; j++) {
+			if(node->meshes[j] == node->meshes[i]) break;
+		}
+		if(j == k) {
+			node->meshes[k++] = node->meshes[i];
+		}
+	}
+	while(node->num_meshes > k) {
+		node->meshes = mf_dynarr_pop(node->meshes);
+		node->num_meshes--;
+	}
+}
@@ -6,28 +6,55 @@
 #include <stdlib.h>
 #include <string.h>
 #include "dynarr.h"
+#include "mfpriv.h"
 
 /* The array descriptor keeps auxilliary information needed to manipulate
- * the dynamic array. It's allocated adjacent to the array buffer.
+ * the dynamic array. It's allocated adjacent to the array buffer. Its size is
+ * kept a multiple of 16, so that the array itself stays suitably aligned.
  */
 struct arrdesc {
 	int nelem, szelem;
 	int max_elem;
 	int bufsz;	/* not including the descriptor */
+	int refcnt;
+	int tag;	/* memory accounting category */
+	int pad[2];
 };
 
+#ifdef __GNUC__
+#define REF_INC(x)	__atomic_add_fetch(&(x), 1, __ATOMIC_ACQ_REL)
+#define REF_DEC(x)	__atomic_sub_fetch(&(x), 1, __ATOMIC_ACQ_REL)
+#define REF_GET(x)	__atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#else
+#define REF_INC(x)	(++(x))
+#define REF_DEC(x)	(--(x))
+#define REF_GET(x)	(x)
+#endif
+
 #define DESC(x)		((struct arrdesc*)((char*)(x) - sizeof(struct arrdesc)))
 
 void *mf_dynarr_alloc(int elem, int szelem)
+{
+	return mf_dynarr_alloc_tag(elem, szelem, MF_MEM_OTHER);
+}
+
+void *mf_dynarr_alloc_tag(int elem, int szelem, int tag)
 {
 	struct arrdesc *desc;
 
+	if(MF_MEM_CHECK(elem * szelem + sizeof *desc) == -1) {
+		return 0;
+	}
 	if(!(desc = malloc(elem * szelem + sizeof *desc))) {
 		return 0;
 	}
+	MF_COUNT_ALLOC();
+	MF_MEM_ACCT(tag, elem * szelem + sizeof *desc);
 	desc->nelem = desc->max_elem = elem;
 	desc->szelem = szelem;
 	desc->bufsz = elem * szelem;
+	desc->refcnt = 1;
+	desc->tag = tag;
 	return (char*)desc + sizeof *desc;
 }
 
@@ -42,11 +69,48 @@ void *mf_dynarr_alloc_ordie(int elem, int szelem)
 
 void mf_dynarr_free(void *da)
 {
-	if(da) {
+	if(da && REF_DEC(DESC(da)->refcnt) == 0) {
+		MF_MEM_ACCT(DESC(da)->tag, -(long)(DESC(da)->bufsz + sizeof(struct arrdesc)));
 		free(DESC(da));
 	}
 }
 
+void *mf_dynarr_ref(void *da)
+{
+	if(da) {
+		REF_INC(DESC(da)->refcnt);
+	}
+	return da;
+}
+
+int mf_dynarr_shared(void *da)
+{
+	return da && REF_GET(DESC(da)->refcnt) > 1;
+}
+
+long mf_dynarr_memsize(void *da)
+{
+	return da ? DESC(da)->bufsz + sizeof(struct arrdesc) : 0;
+}
+
+void *mf_dynarr_unshare(void *da)
+{
+	void *copy;
+	struct arrdesc *desc;
+
+	if(!mf_dynarr_shared(da)) {
+		return da;
+	}
+	desc = DESC(da);
+
+	if(!(copy = mf_dynarr_alloc_tag(desc->nelem, desc->szelem, desc->tag))) {
+		return 0;
+	}
+	memcpy(copy, da, desc->nelem * desc->szelem);
+	mf_dynarr_free(da);
+	return copy;
+}
+
 void *mf_dynarr_resize(void *da, int elem)
 {
 	int newsz;
@@ -56,12 +120,27 @@ void *mf_dynarr_resize(void *da, int elem)
 	if(!da) return 0;
 	desc = DESC(da);
 
+	if(mf_dynarr_shared(da)) {
+		/* copy on write, keep only what fits in the new size */
+		if(!(tmp = mf_dynarr_alloc_tag(elem, desc->szelem, desc->tag))) {
+			return 0;
+		}
+		memcpy(tmp, da, (elem < desc->nelem ? elem : desc->nelem) * desc->szelem);
+		mf_dynarr_free(da);
+		return tmp;
+	}
+
 	newsz = desc->szelem * elem;
 
+	if(newsz > desc->bufsz && MF_MEM_CHECK(newsz - desc->bufsz) == -1) {
+		return 0;
+	}
 	if(!(tmp = realloc(desc, newsz + sizeof *desc))) {
 		return 0;
 	}
+	MF_COUNT_ALLOC();
 	desc = tmp;
+	MF_MEM_ACCT(desc->tag, newsz - desc->bufsz);
 
 	desc->nelem = desc->max_elem = elem;
 	desc->bufsz = newsz;
@@ -81,7 +160,7 @@ int mf_dynarr_size(void *da)
 
 void *mf_dynarr_clear(void *da)
 {
-	return mf_dynarr_resize(da, 0);
+	return mf_dynarr_resize(da, 0);	/* no copy for shared arrays, nothing fits */
 }
 
 /* stack semantics */
@@ -90,6 +169,13 @@ void *mf_dynarr_push(void *da, void *item)
 	struct arrdesc *desc;
 	int nelem;
 
+	if(!da) return 0;
+
+	if(mf_dynarr_shared(da)) {
+		/* copy on write, with room to grow */
+		return mf_dynarr_pushn(da, item, 1);
+	}
+
 	desc = DESC(da);
 	nelem = desc->nelem;
 
@@ -99,8 +185,7 @@ void *mf_dynarr_push(void *da, void *item)
 		int newsz = desc->max_elem ? desc->max_elem * 2 : 1;
 
 		if(!(tmp = mf_dynarr_resize(da, newsz))) {
-			fprintf(stderr, "failed to resize\n");
-			return da;
+			return 0;
 		}
 		da = tmp;
 		desc = DESC(da);
@@ -114,6 +199,57 @@ void *mf_dynarr_push(void *da, void *item)
 	return da;
 }
 
+/* append n items at once, or n uninitialized items if items is null */
+void *mf_dynarr_pushn(void *da, const void *items, int n)
+{
+	struct arrdesc *desc;
+	int nelem;
+
+	if(!(da = mf_dynarr_reserve(da, DESC(da)->nelem + n))) {
+		return 0;
+	}
+	desc = DESC(da);
+	nelem = desc->nelem;
+
+	if(items) {
+		memcpy((char*)da + nelem * desc->szelem, items, n * desc->szelem);
+	}
+	desc->nelem += n;
+	return da;
+}
+
+void *mf_dynarr_reserve(void *da, int elem)
+{
+	struct arrdesc *desc = DESC(da);
+	int nelem, newsz, shared;
+	void *tmp;
+
+	shared = mf_dynarr_shared(da);
+	if(elem <= desc->max_elem && !shared) {
+		return da;
+	}
+
+	nelem = desc->nelem;
+	newsz = desc->max_elem;
+	if(elem > newsz) {
+		newsz = newsz * 2 < elem ? elem : newsz * 2;
+	}
+
+	if(shared) {
+		if(!(tmp = mf_dynarr_alloc_tag(newsz, desc->szelem, desc->tag))) {
+			return 0;
+		}
+		memcpy(tmp, da, nelem * desc->szelem);
+		mf_dynarr_free(da);
+	} else {
+		if(!(tmp = mf_dynarr_resize(da, newsz))) {
+			return 0;
+		}
+	}
+	DESC(tmp)->nelem = nelem;
+	return tmp;
+}
+
 void *mf_dynarr_pop(void *da)
 {
 	struct arrdesc *desc;
@@ -124,6 +260,18 @@ void *mf_dynarr_pop(void *da)
 
 	if(!nelem) return da;
 
+	if(mf_dynarr_shared(da)) {
+		/* copy on write, there's no point copying the last element */
+		void *tmp;
+		if(!(tmp = mf_dynarr_alloc_tag(nelem - 1, desc->szelem, desc->tag))) {
+			fprintf(stderr, "failed to copy shared array\n");
+			return da;
+		}
+		memcpy(tmp, da, (nelem - 1) * desc->szelem);
+		mf_dynarr_free(da);
+		return tmp;
+	}
+
 	if(nelem <= desc->max_elem / 3) {
 		/* reclaim space */
 		struct arrdesc *tmp;
@@ -28,6 +28,26 @@ void *mf_dynarr_alloc(int elem, int szelem);
 void mf_dynarr_free(void *da);
 void *mf_dynarr_resize(void *da, int elem);
 
+/* same as mf_dynarr_alloc, with the memory accounting category (MF_MEM_*) of
+ * the array, which is kept across resizing and copies. mf_dynarr_memsize
+ * returns the number of bytes allocated for the array.
+ */
+void *mf_dynarr_alloc_tag(int elem, int szelem, int tag);
+long mf_dynarr_memsize(void *da);
+
+/* Reference counting with copy on write. mf_dynarr_ref returns the same array
+ * with its reference count incremented, and mf_dynarr_free only releases the
+ * array when the last reference goes away. Resizing, pushing or popping a
+ * shared array makes a private copy first. Writing elements directly doesn't,
+ * so call mf_dynarr_unshare before modifying a potentially shared array in
+ * place. mf_dynarr_unshare returns the array itself if it's not shared, or a
+ * private copy, or 0 if it fails to allocate the copy (in which case the
+ * original is left untouched).
+ */
+void *mf_dynarr_ref(void *da);
+int mf_dynarr_shared(void *da);
+void *mf_dynarr_unshare(void *da);
+
 /* mf_dynarr_empty returns non-zero if the array is empty
  * Complexity: O(1) */
 int mf_dynarr_empty(void *da);
@@ -37,11 +57,21 @@ int mf_dynarr_size(void *da);
 
 void *mf_dynarr_clear(void *da);
 
-/* stack semantics */
+/* stack semantics. mf_dynarr_push returns 0 on failure, leaving the array
+ * untouched.
+ */
 void *mf_dynarr_push(void *da, void *item);
 void *mf_dynarr_pop(void *da);
 
+/* mf_dynarr_pushn appends n items at once (uninitialized if items is null).
+ * mf_dynarr_reserve makes room for at least elem items, without changing the
+ * size of the array. Both return 0 on failure, leaving the array untouched.
+ */
+void *mf_dynarr_pushn(void *da, const void *items, int n);
+void *mf_dynarr_reserve(void *da, int elem);
+
 /* Finalize the array. No more resizing is possible after this call.
+ * The array must not be shared.
  * Use free() instead of mf_dynarr_free() to deallocate a finalized array.
  * Returns pointer to the finalized array.
  * mf_dynarr_finalize can't fail.
@@ -91,6 +91,7 @@ static int read_percent(float *retval, struct chunk *par, const struct mf_userio
 static int read_str(char *buf, int bufsz, struct chunk *par, const struct mf_userio *io);
 static int read_word(uint16_t *val, struct chunk *par, const struct mf_userio *io);
 static int read_float(float *val, struct chunk *par, const struct mf_userio *io);
+static int read_array(void *buf, int count, int elemsz, struct chunk *par, const struct mf_userio *io);
 
 static int read_chunk(struct chunk *ck, struct chunk *par, const struct mf_userio *io);
 static void skip_chunk(struct chunk *ck, const struct mf_userio *io);
@@ -105,6 +106,9 @@ int mf_load_3ds(struct mf_meshfile *mf, const struct mf_userio *io)
 	}
 
 	while(read_chunk(&ck, &root, io) != -1) {
+		if(MF_CANCELLED(mf)) {
+			return -1;
+		}
 		switch(ck.id) {
 		case CID_3DEDITOR:
 			break;
@@ -161,7 +165,7 @@ static int read_material(struct mf_meshfile *mf, struct chunk *par, const struct
 
 		switch(ck.id) {
 		case CID_MTL_NAME:
-			if(!(mtl->name = malloc(datalen))) {
+			if(MF_MEM_CHECK(datalen) == -1 || !(mtl->name = malloc(datalen))) {
 				goto err;
 			}
 			if(io->read(io->file, mtl->name, datalen) < datalen) {
@@ -326,6 +330,9 @@ static int read_object(struct mf_meshfile *mf, struct chunk *par, const struct m
 	}
 
 	while(read_chunk(&ck, par, io) != -1) {
+		if(MF_CANCELLED(mf)) {
+			goto err;
+		}
 		switch(ck.id) {
 		case CID_TRIMESH:
 			if(read_trimesh(mf, mesh, node, &ck, io) == -1) {
@@ -367,13 +374,17 @@ err:
 
 static const int mrow_offs[] = {0, 8, 4, 12};
 
+/* vertex/face lists are read this many elements at a time */
+#define RD_BLOCK	256
+
 static int read_trimesh(struct mf_meshfile *mf, struct mf_mesh *mesh, struct mf_node *node,
 		struct chunk *par, const struct mf_userio *io)
 {
 	struct chunk ck;
-	mf_vec3 vec;
-	uint16_t nverts, nfaces, vidx[3];
-	int i, j;
+	uint16_t nverts, nfaces;
+	int i, j, n;
+	float fbuf[RD_BLOCK * 3], *fptr;
+	uint16_t wbuf[RD_BLOCK * 4], *wptr;
 	float *mptr = 0;
 	float tmp;
 	char buf[64];
@@ -381,22 +392,28 @@ static int read_trimesh(struct mf_meshfile *mf, struct mf_mesh *mesh, struct mf_
 	float inv_xform[16];
 
 	while(read_chunk(&ck, par, io) != -1) {
+		if(MF_CANCELLED(mf)) {
+			goto err;
+		}
 		switch(ck.id) {
 		case CID_VERTLIST:
 			if(read_word(&nverts, &ck, io) == -1) {
 				fprintf(stderr, "load_3ds: failed to read vertex count\n");
 				goto err;
 			}
-			for(i=0; i<(int)nverts; i++) {
-				if(read_float(&vec.x, &ck, io) == -1 ||
-						read_float(&vec.y, &ck, io) == -1 ||
-						read_float(&vec.z, &ck, io) == -1) {
+			for(i=0; i<(int)nverts; i+=n) {
+				n = nverts - i < RD_BLOCK ? nverts - i : RD_BLOCK;
+				if(read_array(fbuf, n * 3, 4, &ck, io) == -1) {
 					fprintf(stderr, "load_3ds: failed to read vertex\n");
 					goto err;
 				}
-				if(mf_add_vertex(mesh, vec.x, vec.z, -vec.y) == -1) {
-					fprintf(stderr, "load_3ds: failed to add vertex\n");
-					goto err;
+				fptr = fbuf;
+				for(j=0; j<n; j++) {
+					if(mf_add_vertex(mesh, fptr[0], fptr[2], -fptr[1]) == -1) {
+						fprintf(stderr, "load_3ds: failed to add vertex\n");
+						goto err;
+					}
+					fptr += 3;
 				}
 			}
 			break;
@@ -406,14 +423,19 @@ static int read_trimesh(struct mf_meshfile *mf, struct mf_mesh *mesh, struct mf_
 				fprintf(stderr, "load_3ds: failed to read texture coordinate count\n");
 				goto err;
 			}
-			for(i=0; i<(int)nverts; i++) {
-				if(read_float(&vec.x, &ck, io) == -1 || read_float(&vec.y, &ck, io) == -1) {
+			for(i=0; i<(int)nverts; i+=n) {
+				n = nverts - i < RD_BLOCK ? nverts - i : RD_BLOCK;
+				if(read_array(fbuf, n * 2, 4, &ck, io) == -1) {
 					fprintf(stderr, "load_3ds: failed to read texture coordinates\n");
 					goto err;
 				}
-				if(mf_add_texcoord(mesh, vec.x, vec.y) == -1) {
-					fprintf(stderr, "load_3ds: failed to add texcoord\n");
-					goto err;
+				fptr = fbuf;
+				for(j=0; j<n; j++) {
+					if(mf_add_texcoord(mesh, fptr[0], fptr[1]) == -1) {
+						fprintf(stderr, "load_3ds: failed to add texcoord\n");
+						goto err;
+					}
+					fptr += 2;
 				}
 			}
 			break;
@@ -423,17 +445,21 @@ static int read_trimesh(struct mf_meshfile *mf, struct mf_mesh *mesh, struct mf_
 				fprintf(stderr, "load_3ds: failed to read face count\n");
 				goto err;
 			}
-			for(i=0; i<(int)nfaces; i++) {
-				if(read_word(vidx, &ck, io) == -1 || read_word(vidx + 1, &ck, io) == -1 ||
-						read_word(vidx + 2, &ck, io) == -1) {
+			for(i=0; i<(int)nfaces; i+=n) {
+				n = nfaces - i < RD_BLOCK ? nfaces - i : RD_BLOCK;
+				if(read_array(wbuf, n * 4, 2, &ck, io) == -1) {
 					fprintf(stderr, "load_3ds: failed to read face\n");
 					goto err;
 				}
-				if(mf_add_triangle(mesh, vidx[0], vidx[1], vidx[2]) == -1) {
-					fprintf(stderr, "load_3ds: failed to add face\n");
-					goto err;
+				wptr = wbuf;
+				for(j=0; j<n; j++) {
+					/* 4th word is the edge flags, ignore it */
+					if(mf_add_triangle(mesh, wptr[0], wptr[1], wptr[2]) == -1) {
+						fprintf(stderr, "load_3ds: failed to add face\n");
+						goto err;
+					}
+					wptr += 4;
 				}
-				read_word(vidx, &ck, io);	/* ignore edge flags */
 			}
 			break;
 
@@ -508,11 +534,7 @@ static int read_color(mf_vec4 *col, struct chunk *par, const struct mf_userio *i
 		if(io->read(io->file, col, 3 * sizeof(float)) < 3 * sizeof(float)) {
 			return -1;
 		}
-		if(TARGET_BIGEND) {
-			BSWAPFLT(col->x);
-			BSWAPFLT(col->y);
-			BSWAPFLT(col->z);
-		}
+		mf_le32_array(col, 3);
 		res = 0;
 		break;
 
@@ -585,6 +607,24 @@ static int read_word(uint16_t *val, struct chunk *par, const struct mf_userio *i
 	return 0;
 }
 
+static int read_array(void *buf, int count, int elemsz, struct chunk *par, const struct mf_userio *io)
+{
+	long sz = (long)count * elemsz;
+	long fpos = io->seek(io->file, 0, MF_SEEK_CUR);
+	if(fpos + sz > par->endpos) {
+		return -1;
+	}
+	if(io->read(io->file, buf, sz) < sz) {
+		return -1;
+	}
+	if(elemsz == 4) {
+		mf_le32_array(buf, count);
+	} else {
+		mf_le16_array(buf, count);
+	}
+	return 0;
+}
+
 static int read_float(float *val, struct chunk *par, const struct mf_userio *io)
 {
 	long fpos = io->seek(io->file, 0, MF_SEEK_CUR);
@@ -639,7 +679,6 @@ static int write_chunk_str(uint16_t id, uint32_t sz, const char *str, const stru
 static int write_word(uint16_t val, const struct mf_userio *io);
 static int write_dword(uint32_t val, const struct mf_userio *io);
 static int write_float(float val, const struct mf_userio *io);
-static int write_vector(mf_vec3 v, const struct mf_userio *io);
 
 int mf_save_3ds(const struct mf_meshfile *mf, const struct mf_userio *io)
 {
@@ -699,6 +738,9 @@ static int write_3ded(const struct mf_meshfile *mf, const struct mf_userio *io)
 	for(i=0; i<num; i++) {
 		node = mf_get_node(mf, i);
 		for(j=0; j<node->num_meshes; j++) {
+			if(MF_CANCELLED(mf)) {
+				return -1;
+			}
 			if(write_mesh(node, node->meshes[j], io) == -1) {
 				fprintf(stderr, "save_3ds: failed to write object\n");
 				return -1;
@@ -826,6 +868,8 @@ static int write_mesh(const struct mf_node *node, const struct mf_mesh *mesh, co
 	const char *mtlname = mesh->mtl->name;
 	mf_vec3 v;
 	struct mf_face *face;
+	float vrec[3];
+	uint16_t frec[4];
 
 	if(mesh->num_verts >= 65536 || mesh->num_faces >= 65536) {
 		/* TODO split large meshes */
@@ -852,7 +896,11 @@ static int write_mesh(const struct mf_node *node, const struct mf_mesh *mesh, co
 	if(write_word(mesh->num_verts, io) == -1) return -1;
 	for(i=0; i<mesh->num_verts; i++) {
 		mf_transform(&v, mesh->vertex + i, node->global_matrix);
-		if(write_vector(v, io) == -1) {
+		vrec[0] = v.x;
+		vrec[1] = -v.z;
+		vrec[2] = v.y;
+		mf_le32_array(vrec, 3);
+		if(io->write(io->file, vrec, sizeof vrec) < (int)sizeof vrec) {
 			return -1;
 		}
 	}
@@ -861,10 +909,14 @@ static int write_mesh(const struct mf_node *node, const struct mf_mesh *mesh, co
 	if(write_word(mesh->num_faces, io) == -1) return -1;
 	for(i=0; i<mesh->num_faces; i++) {
 		face = mesh->faces + i;
-		if(write_word(face->vidx[0], io) == -1) return -1;
-		if(write_word(face->vidx[1], io) == -1) return -1;
-		if(write_word(face->vidx[2], io) == -1) return -1;
-		if(write_word(7, io) == -1) return -1;
+		frec[0] = face->vidx[0];
+		frec[1] = face->vidx[1];
+		frec[2] = face->vidx[2];
+		frec[3] = 7;
+		mf_le16_array(frec, 4);
+		if(io->write(io->file, frec, sizeof frec) < (int)sizeof frec) {
+			return -1;
+		}
 	}
 
 	if(write_chunk_str(CID_FACEMTL, mtlsz, mtlname, io) == -1) return -1;
@@ -961,10 +1013,3 @@ static int write_float(float val, const struct mf_userio *io)
 	return io->write(io->file, &val, sizeof val) < sizeof val ? -1 : 0;
 }
 
-static int write_vector(mf_vec3 v, const struct mf_userio *io)
-{
-	if(write_float(v.x, io) == -1) return -1;
-	if(write_float(-v.z, io) == -1) return -1;
-	if(write_float(v.y, io) == -1) return -1;
-	return 0;
-}
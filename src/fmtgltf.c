@@ -23,6 +23,9 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "json.h"
 #include "dynarr.h"
 #include "util.h"
+#include "bufio.h"
+#include "rbtree.h"
+#include "trace.h"
 
 enum {
 	GLTF_BYTE =	5120,
@@ -112,6 +115,9 @@ struct gltf_file {
 	struct node *nodes;
 
 	unsigned char *glbdata;
+	unsigned long glbsize;
+
+	struct rbtree *nodeidx;		/* node pointer -> index, for writing */
 };
 
 static int init_gltf(struct gltf_file *gltf);
@@ -186,7 +192,10 @@ static void destroy_gltf(struct gltf_file *gltf)
 	mf_dynarr_free(gltf->samplers);
 	mf_dynarr_free(gltf->textures);
 	for(i=0; i<mf_dynarr_size(gltf->buffers); i++) {
-		free(gltf->buffers[i].data);
+		if(gltf->buffers[i].data) {
+			MF_MEM_ACCT(MF_MEM_OTHER, -(long)gltf->buffers[i].size);
+			free(gltf->buffers[i].data);
+		}
 	}
 	mf_dynarr_free(gltf->buffers);
 	mf_dynarr_free(gltf->bufviews);
@@ -196,7 +205,11 @@ static void destroy_gltf(struct gltf_file *gltf)
 		mf_free_node(gltf->nodes[i].mfnode);
 	}
 	mf_dynarr_free(gltf->nodes);
+	MF_MEM_ACCT(MF_MEM_OTHER, -(long)gltf->glbsize);
 	free(gltf->glbdata);
+	if(gltf->nodeidx) {
+		rb_free(gltf->nodeidx);
+	}
 }
 
 int mf_load_gltf(struct mf_meshfile *mf, const struct mf_userio *io)
@@ -211,6 +224,7 @@ int mf_load_gltf(struct mf_meshfile *mf, const struct mf_userio *io)
 	struct gltf_file gltf_file = {0};
 	struct gltf_file *gltf = &gltf_file;
 	struct chunkhdr chunk;
+	double tspan;
 
 	if(!(filebuf = malloc(256))) {
 		fprintf(stderr, "mf_load: failed to allocate file buffer\n");
@@ -237,7 +251,7 @@ int mf_load_gltf(struct mf_meshfile *mf, const struct mf_userio *io)
 		CONV_LE32(chunk.len);
 
 		free(filebuf);
-		if(!(filebuf = malloc(chunk.len + 1))) {
+		if(MF_MEM_CHECK(chunk.len + 1) == -1 || !(filebuf = malloc(chunk.len + 1))) {
 			fprintf(stderr, "gltf_load: failed to allocate JSON buffer\n");
 			goto end;
 		}
@@ -265,7 +279,7 @@ int mf_load_gltf(struct mf_meshfile *mf, const struct mf_userio *io)
 		/* read the whole file into memory */
 		free(filebuf);
 		io->seek(io->file, 0, MF_SEEK_SET);
-		if(!(filebuf = malloc(filesz + 1))) {
+		if(MF_MEM_CHECK(filesz + 1) == -1 || !(filebuf = malloc(filesz + 1))) {
 			fprintf(stderr, "mf_load: failed to load file into memory\n");
 			return -1;
 		}
@@ -278,9 +292,11 @@ int mf_load_gltf(struct mf_meshfile *mf, const struct mf_userio *io)
 	}
 
 	json_init_obj(&root);
+	TRACE_BEGIN(tspan);
 	if(json_parse(&root, filebuf) == -1) {
 		goto end;
 	}
+	TRACE_END(tspan, "json_parse");
 	free(filebuf);
 	filebuf = 0;
 
@@ -300,10 +316,12 @@ int mf_load_gltf(struct mf_meshfile *mf, const struct mf_userio *io)
 		while(io->read(io->file, &chunk, 8) == 8) {
 			if(memcmp(&chunk.type, "BIN", 4) == 0) {
 				CONV_LE32(chunk.len);
-				if(!(gltf->glbdata = malloc(chunk.len))) {
+				if(MF_MEM_CHECK(chunk.len) == -1 || !(gltf->glbdata = malloc(chunk.len))) {
 					fprintf(stderr, "gltf_load: failed to allocate binary chunk data buffer\n");
 					goto end;
 				}
+				gltf->glbsize = chunk.len;
+				MF_MEM_ACCT(MF_MEM_OTHER, chunk.len);
 				if(io->read(io->file, gltf->glbdata, chunk.len) < chunk.len) {
 					fprintf(stderr, "gltf_load: unexpected EOF while reading binary chunk data\n");
 					goto end;
@@ -323,6 +341,9 @@ int mf_load_gltf(struct mf_meshfile *mf, const struct mf_userio *io)
 			}
 
 			for(j=0; j<jitem->val.arr.size; j++) {
+				if(MF_CANCELLED(mf) || mf->memacct.over) {
+					goto end;
+				}
 				jval = jitem->val.arr.val + j;
 
 				if(jval->type != JSON_OBJ) {
@@ -382,7 +403,9 @@ static int proc_node(struct node *nodes, int nidx)
 static int read_data(struct mf_meshfile *mf, void *buf, unsigned long sz, const char *str,
 		const struct mf_userio *io)
 {
-	void *file;
+	int rdbytes;
+	struct mf_userio subio;
+	double tspan;
 
 	if(memcmp(str, "data:", 5) == 0) {
 		if(!(str = strstr(str, "base64,"))) {
@@ -391,15 +414,19 @@ static int read_data(struct mf_meshfile *mf, void *buf, unsigned long sz, const
 		}
 		str += 7;
 
+		TRACE_BEGIN(tspan);
 		mf_b64decode(str, buf, (long*)&sz);
+		TRACE_END(tspan, "b64decode");
 
 	} else {
 		str = mf_find_asset(mf, str);
-		if(!(file = io->open(str, "rb"))) {
+		if(mf_subio_open(&subio, io, str, "rb") == -1) {
 			fprintf(stderr, "load_gltf: failed to load external data file: %s\n", str);
 			return -1;
 		}
-		if(io->read(file, buf, sz) != sz) {
+		rdbytes = subio.read(subio.file, buf, sz);
+		mf_subio_close(&subio);
+		if(rdbytes != sz) {
 			fprintf(stderr, "load_gltf: unexpected EOF while reading data file: %s\n", str);
 			return -1;
 		}
@@ -622,7 +649,7 @@ static int read_buffer(struct mf_meshfile *mf, struct gltf_file *gltf, struct js
 	}
 
 	if((jval = json_lookup(jbuf, "uri"))) {
-		if(!(buf.data = malloc(buf.size))) {
+		if(MF_MEM_CHECK(buf.size) == -1 || !(buf.data = malloc(buf.size))) {
 			fprintf(stderr, "load_gltf: failed to allocate %ld byte buffer\n", buf.size);
 			return -1;
 		}
@@ -630,6 +657,7 @@ static int read_buffer(struct mf_meshfile *mf, struct gltf_file *gltf, struct js
 			free(buf.data);
 			return -1;
 		}
+		MF_MEM_ACCT(MF_MEM_OTHER, buf.size);
 
 	} else if(!gltf->glbdata) {
 		fprintf(stderr, "load_gltf: missing or invalid uri in buffer\n");
@@ -638,6 +666,9 @@ static int read_buffer(struct mf_meshfile *mf, struct gltf_file *gltf, struct js
 
 	if(!(ptr = mf_dynarr_push(gltf->buffers, &buf))) {
 		fprintf(stderr, "load_gltf: failed to add buffer\n");
+		if(buf.data) {
+			MF_MEM_ACCT(MF_MEM_OTHER, -(long)buf.size);
+		}
 		free(buf.data);
 		return -1;
 	}
@@ -835,7 +866,7 @@ err:
 static struct accessor *find_accessor(struct gltf_file *gltf, struct json_obj *jattr, const char *name)
 {
 	int idx = json_lookup_int(jattr, name, -1);
-	if(idx < 0) return 0;
+	if(idx < 0 || idx >= mf_dynarr_size(gltf->accessors)) return 0;
 	return gltf->accessors + idx;
 }
 
@@ -867,11 +898,7 @@ static int read_mesh_attr(struct mf_mesh *mesh, struct gltf_file *gltf, struct a
 		case GLTF_FLOAT:
 			memcpy(vec, src, acc->nelem * sizeof(float));
 			src += acc->nelem * sizeof(float);
-			if(TARGET_BIGEND) {
-				for(j=0; j<acc->nelem; j++) {
-					BSWAPFLT(vec[j]);
-				}
-			}
+			mf_le32_array(vec, acc->nelem);
 			break;
 
 		case GLTF_UBYTE:
@@ -1051,30 +1078,28 @@ static void write_node(const struct mf_meshfile *mf, struct gltf_file *gltf,
 static void write_mtl(const struct mf_meshfile *mf, struct gltf_file *gltf,
 		const struct mf_material *mtl, const struct mf_userio *io);
 static int get_texidx(struct gltf_file *gltf, const char *name);
+static int build_nodeidx(const struct mf_meshfile *mf, struct gltf_file *gltf);
+static int get_nodeidx(struct gltf_file *gltf, const struct mf_node *node);
 
 #define wrind(lvl) mf_fputs(indent(lvl), io)
 
-#define THINGIDX(idx, ptr, arr) \
-	do { \
-		for((idx) = 0; (idx) < mf_dynarr_size(arr); (idx)++) { \
-			if((arr)[idx] == (ptr)) { \
-				break; \
-			} \
-		} \
-	} while(0)
-
 const char *outhdr = "{\n"
 	"    \"asset\": { \"generator\": \"libmeshfile\", \"version\": \"2.0\" },\n"
 	"    \"scene\": 0,\n";
 
 int mf_save_gltf(const struct mf_meshfile *mf, const struct mf_userio *io)
 {
-	int i, idx, num;
+	int i, num;
 	struct gltf_file gltf;
 
 	if(init_gltf(&gltf) == -1) {
 		return -1;
 	}
+	if(build_nodeidx(mf, &gltf) == -1) {
+		fprintf(stderr, "save_gltf: failed to build node index\n");
+		destroy_gltf(&gltf);
+		return -1;
+	}
 
 	mf_fputs(outhdr, io);
 	/* root nodes in scene */
@@ -1082,8 +1107,7 @@ int mf_save_gltf(const struct mf_meshfile *mf, const struct mf_userio *io)
 	wrind(2); mf_fputs("\"nodes\": [\n", io);
 	num = mf_num_topnodes(mf);
 	for(i=0; i<num; i++) {
-		THINGIDX(idx, mf->topnodes[i], mf->nodes);
-		mf_fprintf(io, "%s%d", indent(3), idx);
+		mf_fprintf(io, "%s%d", indent(3), get_nodeidx(&gltf, mf->topnodes[i]));
 		if(i < num - 1) {
 			mf_fputs(",\n", io);
 		}
@@ -1094,6 +1118,10 @@ int mf_save_gltf(const struct mf_meshfile *mf, const struct mf_userio *io)
 	wrind(1); mf_fputs("\"nodes\": [\n", io);
 	num = mf_num_nodes(mf);
 	for(i=0; i<num; i++) {
+		if(MF_CANCELLED(mf)) {
+			destroy_gltf(&gltf);
+			return -1;
+		}
 		write_node(mf, &gltf, mf->nodes[i], io);
 	}
 	wrind(1); mf_fputs("]\n", io);
@@ -1114,21 +1142,23 @@ int mf_save_gltf(const struct mf_meshfile *mf, const struct mf_userio *io)
 
 static const char *indent(int lvl)
 {
-	static char buf[128];
-	char *ptr = buf;
+	/* return the tail of a constant string, so that concurrent saves from
+	 * multiple threads don't trample on each other's indentation buffer
+	 */
+	static const char spaces[] = "                                "
+		"                                ";
+	const char *end = spaces + sizeof spaces - 1;
 
-	while(lvl-- > 0) {
-		memcpy(ptr, "    ", 4);
-		ptr += 4;
+	if(lvl * 4 > sizeof spaces - 1) {
+		return spaces;
 	}
-	*ptr = 0;
-	return buf;
+	return end - lvl * 4;
 }
 
 static void write_node(const struct mf_meshfile *mf, struct gltf_file *gltf,
 		const struct mf_node *node, const struct mf_userio *io)
 {
-	int i, idx;
+	int i;
 	const float *mat = node->matrix;
 
 	wrind(2); mf_fputs("{\n", io);
@@ -1146,8 +1176,7 @@ static void write_node(const struct mf_meshfile *mf, struct gltf_file *gltf,
 	if(node->num_child > 0) {
 		wrind(3); mf_fputs("\"children\": [\n", io);
 		for(i=0; i<node->num_child; i++) {
-			THINGIDX(idx, node->child[i], mf->nodes);
-			mf_fprintf(io, "%s%d", indent(4), idx);
+			mf_fprintf(io, "%s%d", indent(4), get_nodeidx(gltf, node->child[i]));
 			if(i < node->num_child - 1) {
 				mf_fputs(",\n", io);
 			} else {
@@ -1220,6 +1249,35 @@ static int get_texidx(struct gltf_file *gltf, const char *name)
 	return -1;	/* TODO */
 }
 
+/* nodes refer to each other by index in the output, so map node pointers to
+ * their position in mf->nodes up front, instead of searching for every child.
+ */
+static int build_nodeidx(const struct mf_meshfile *mf, struct gltf_file *gltf)
+{
+	int i, num;
+
+	if(!(gltf->nodeidx = rb_create(RB_KEY_ADDR))) {
+		return -1;
+	}
+	num = mf_num_nodes(mf);
+	for(i=0; i<num; i++) {
+		if(rb_insert(gltf->nodeidx, mf->nodes[i], (void*)(intptr_t)i) == -1) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int get_nodeidx(struct gltf_file *gltf, const struct mf_node *node)
+{
+	struct rbnode *rbn;
+
+	if(!(rbn = rb_find(gltf->nodeidx, (void*)node))) {
+		return -1;
+	}
+	return (intptr_t)rbn->data;
+}
+
 
 static int jarr_to_vec4(struct json_arr *jarr, mf_vec4 *vec)
 {
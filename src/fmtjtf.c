@@ -56,7 +56,7 @@ int mf_load_jtf(struct mf_meshfile *mf, const struct mf_userio *io)
 	struct jtf_header hdr;
 	struct jtf_face face;
 	struct mf_mesh *mesh;
-	struct mf_node *node;
+	struct mf_node *node = 0;
 
 	if(io->read(io->file, &hdr, sizeof hdr) < sizeof hdr) {
 		return -1;
@@ -66,6 +66,12 @@ int mf_load_jtf(struct mf_meshfile *mf, const struct mf_userio *io)
 	}
 	CONV_LE32(hdr.nfaces);
 
+	/* three vertices with normals and texcoords, and a triangle per face */
+	if(MF_MEM_CHECK((unsigned long)hdr.nfaces * (3 * sizeof(struct jtf_vertex) +
+				sizeof(mf_face))) == -1) {
+		return -1;
+	}
+
 	if(!(mesh = mf_alloc_mesh())) {
 		fprintf(stderr, "jtf: failed to allocate mesh\n");
 		return -1;
@@ -77,22 +83,16 @@ int mf_load_jtf(struct mf_meshfile *mf, const struct mf_userio *io)
 
 	vidx = 0;
 	for(i=0; i<hdr.nfaces; i++) {
+		if(MF_CANCELLED(mf)) {
+			goto err;
+		}
 		if(io->read(io->file, &face, sizeof face) < sizeof face) {
 			fprintf(stderr, "jtf: unexpected EOF while reading faces\n");
 			goto err;
 		}
+		mf_le32_array(&face, sizeof face / 4);
 
 		for(j=0; j<3; j++) {
-			if(TARGET_BIGEND) {
-				BSWAPFLT(face.v[j].pos.x);
-				BSWAPFLT(face.v[j].pos.y);
-				BSWAPFLT(face.v[j].pos.z);
-				BSWAPFLT(face.v[j].norm.x);
-				BSWAPFLT(face.v[j].norm.y);
-				BSWAPFLT(face.v[j].norm.z);
-				BSWAPFLT(face.v[j].uv.x);
-				BSWAPFLT(face.v[j].uv.y);
-			}
 			if(mf_add_vertex(mesh, face.v[j].pos.x, face.v[j].pos.y, face.v[j].pos.z) == -1) {
 				goto err;
 			}
@@ -103,23 +103,33 @@ int mf_load_jtf(struct mf_meshfile *mf, const struct mf_userio *io)
 				goto err;
 			}
 		}
-		mf_add_triangle(mesh, vidx, vidx + 1, vidx + 2);
+		if(mf_add_triangle(mesh, vidx, vidx + 1, vidx + 2) == -1) {
+			goto err;
+		}
 		vidx += 3;
 	}
 
 	if(!(node = mf_alloc_node())) {
 		goto err;
 	}
+	if(!(node->name = strdup(mesh->name))) {
+		fprintf(stderr, "jtf: failed to allocate node name\n");
+		goto err;
+	}
 	if(mf_node_add_mesh(node, mesh) == -1) {
 		goto err;
 	}
 	if(mf_add_mesh(mf, mesh) == -1) {
 		goto err;
 	}
-	mf_add_node(mf, node);
+	if(mf_add_node(mf, node) == -1) {
+		mf_free_node(node);	/* mesh is owned by mf at this point */
+		return -1;
+	}
 	return 0;
 
 err:
+	mf_free_node(node);
 	mf_free_mesh(mesh);
 	return -1;
 }
@@ -150,6 +160,9 @@ int mf_save_jtf(const struct mf_meshfile *mf, const struct mf_userio *io)
 	}
 
 	for(i=0; i<(unsigned int)mf_num_meshes(mf); i++) {
+		if(MF_CANCELLED(mf)) {
+			return -1;
+		}
 		mesh = mf_get_mesh(mf, i);
 		mff = mesh->faces;
 		for(j=0; j<mesh->num_faces; j++) {
@@ -158,18 +171,8 @@ int mf_save_jtf(const struct mf_meshfile *mf, const struct mf_userio *io)
 				face.v[k].pos = mesh->vertex[vidx];
 				face.v[k].norm = mesh->normal ? mesh->normal[vidx] : defnorm;
 				face.v[k].uv = mesh->texcoord ? mesh->texcoord[vidx] : defuv;
-
-				if(TARGET_BIGEND) {
-					BSWAPFLT(face.v[k].pos.x);
-					BSWAPFLT(face.v[k].pos.y);
-					BSWAPFLT(face.v[k].pos.z);
-					BSWAPFLT(face.v[k].norm.x);
-					BSWAPFLT(face.v[k].norm.y);
-					BSWAPFLT(face.v[k].norm.z);
-					BSWAPFLT(face.v[k].uv.x);
-					BSWAPFLT(face.v[k].uv.y);
-				}
 			}
+			mf_le32_array(&face, sizeof face / 4);
 			if(io->write(io->file, &face, sizeof face) < sizeof face) {
 				fprintf(stderr, "jtf: failed to write faces\n");
 				return -1;
@@ -22,6 +22,10 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "rbtree.h"
 #include "dynarr.h"
 #include "util.h"
+#include "bufio.h"
+#include "trace.h"
+
+#define DEDUP_SAMPLE	64
 
 
 struct facevertex {
@@ -49,13 +53,14 @@ int mf_load_obj(struct mf_meshfile *mf, const struct mf_userio *io)
 	struct vertex *varr = 0;
 	mf_vec3 *narr = 0;
 	mf_vec2 *tarr = 0;
+	void *tmp;
 	struct rbtree *rbtree = 0;
 	struct mf_mesh *mesh = 0;
-	struct mf_userio subio = {0};
-
-	subio.open = io->open;
-	subio.close = io->close;
-	subio.read = io->read;
+	struct mf_userio subio;
+	double t0 = 0, tdedup = 0;
+	long num_faces = 0, num_timed = 0;
+	int timed = 0;
+	struct mf_load_stats *st = mf->stats_valid ? &mf->stats : 0;
 
 	if(!mf->name && !(mf->name = strdup("<unknown>"))) {
 		fprintf(stderr, "mf_load_userio: failed to allocate name\n");
@@ -68,9 +73,9 @@ int mf_load_obj(struct mf_meshfile *mf, const struct mf_userio *io)
 	}
 	rb_set_delete_func(rbtree, free_rbnode_key, 0);
 
-	if(!(varr = mf_dynarr_alloc(0, sizeof *varr)) ||
-			!(narr = mf_dynarr_alloc(0, sizeof *narr)) ||
-			!(tarr = mf_dynarr_alloc(0, sizeof *tarr))) {
+	if(!(varr = mf_dynarr_alloc_tag(0, sizeof *varr, MF_MEM_ATTR)) ||
+			!(narr = mf_dynarr_alloc_tag(0, sizeof *narr, MF_MEM_ATTR)) ||
+			!(tarr = mf_dynarr_alloc_tag(0, sizeof *tarr, MF_MEM_ATTR))) {
 		fprintf(stderr, "load_obj: failed to allocate vertex attribute arrays\n");
 		goto end;
 	}
@@ -87,6 +92,9 @@ int mf_load_obj(struct mf_meshfile *mf, const struct mf_userio *io)
 		char *line = clean_line(buf);
 		++line_num;
 
+		if(MF_CANCELLED(mf)) {
+			goto end;
+		}
 		if(!line || !*line) continue;
 
 		switch(line[0]) {
@@ -113,10 +121,11 @@ int mf_load_obj(struct mf_meshfile *mf, const struct mf_userio *io)
 					v.rgba_valid = 0;
 					v.r = v.g = v.b = v.a = 1.0f;
 				}
-				if(!(varr = mf_dynarr_push(varr, &v))) {
+				if(!(tmp = mf_dynarr_push(varr, &v))) {
 					fprintf(stderr, "load_obj: failed to resize vertex buffer\n");
 					goto end;
 				}
+				varr = tmp;
 
 			} else if(line[1] == 't' && isspace(line[2])) {
 				/* texcoord */
@@ -126,10 +135,11 @@ int mf_load_obj(struct mf_meshfile *mf, const struct mf_userio *io)
 					goto end;
 				}
 				tc.y = 1.0f - tc.y;
-				if(!(tarr = mf_dynarr_push(tarr, &tc))) {
+				if(!(tmp = mf_dynarr_push(tarr, &tc))) {
 					fprintf(stderr, "load_obj: failed to resize texcoord buffer\n");
 					goto end;
 				}
+				tarr = tmp;
 
 			} else if(line[1] == 'n' && isspace(line[2])) {
 				/* normal */
@@ -138,10 +148,11 @@ int mf_load_obj(struct mf_meshfile *mf, const struct mf_userio *io)
 					fprintf(stderr, "%s:%d: invalid normal definition: \"%s\"\n", mf->name, line_num, line);
 					goto end;
 				}
-				if(!(narr = mf_dynarr_push(narr, &norm))) {
+				if(!(tmp = mf_dynarr_push(narr, &norm))) {
 					fprintf(stderr, "load_obj: failed to resize normal buffer\n");
 					goto end;
 				}
+				narr = tmp;
 			}
 			break;
 
@@ -162,6 +173,13 @@ int mf_load_obj(struct mf_meshfile *mf, const struct mf_userio *io)
 					goto end;
 				}
 
+				/* the lookups are too quick to time them all without the timer
+				 * dominating, so only time every DEDUP_SAMPLE faces, and scale up
+				 */
+				if(st && (timed = (num_faces++ % DEDUP_SAMPLE == 0))) {
+					num_timed++;
+				}
+
 				for(i=0; i<4; i++) {
 					if(!(ptr = parse_face_vert(ptr, &fv, vsz, tsz, nsz))) {
 						if(i < 3) {
@@ -172,7 +190,11 @@ int mf_load_obj(struct mf_meshfile *mf, const struct mf_userio *io)
 						}
 					}
 
-					if((node = rb_find(rbtree, &fv))) {
+					if(timed) t0 = mf_get_time();
+					node = rb_find(rbtree, &fv);
+					if(timed) tdedup += mf_get_time() - t0;
+
+					if(node) {
 						vidx[i] = (uintptr_t)node->data;
 					} else {
 						unsigned int newidx = mesh->num_verts;
@@ -205,13 +227,16 @@ int mf_load_obj(struct mf_meshfile *mf, const struct mf_userio *io)
 						}
 						vidx[i] = newidx;
 
+						if(timed) t0 = mf_get_time();
 						if((newfv = malloc(sizeof *newfv))) {
 							*newfv = fv;
+							MF_MEM_ACCT(MF_MEM_DEDUP, sizeof *newfv);
 						}
 						if(!newfv || rb_insert(rbtree, newfv, (void*)(uintptr_t)newidx) == -1) {
 							fprintf(stderr, "load_obj: failed to insert facevertex to the binary search tree\n");
 							goto end;
 						}
+						if(timed) tdedup += mf_get_time() - t0;
 					}
 				}
 
@@ -249,9 +274,20 @@ int mf_load_obj(struct mf_meshfile *mf, const struct mf_userio *io)
 				}
 				mtlfile = mf_find_asset(mf, mtlfile);
 
-				if((subio.file = io->open(mtlfile, "rb"))) {
+				if(mf_is_stdio(io) && mf_mtlcache_get(mf, mtlfile) != -1) {
+					continue;
+				}
+				if(mf_subio_open(&subio, io, mtlfile, "rb") != -1) {
+					int first_mtl = mf_num_materials(mf);
+					double tspan;
+
+					TRACE_BEGIN(tspan);
 					load_mtl(mf, &subio);
-					io->close(subio.file);
+					mf_subio_close(&subio);
+					if(mf_is_stdio(io)) {
+						mf_mtlcache_put(mtlfile, mf->mtl + first_mtl, mf_num_materials(mf) - first_mtl);
+					}
+					TRACE_END_ARG(tspan, "mtllib", mtlfile);
 				} else {
 					fprintf(stderr, "load_obj: failed to open material library: %s, ignoring\n", mtlfile);
 				}
@@ -264,14 +300,18 @@ int mf_load_obj(struct mf_meshfile *mf, const struct mf_userio *io)
 		}
 	}
 
-	mesh_done(mf, mesh);
-	mesh = 0;
+	if(mesh_done(mf, mesh) != -1) {
+		mesh = 0;	/* owned by mf now, otherwise it's freed below */
+	}
 
 	if(!mf_dynarr_empty(mf->meshes)) {
 		result = 0;	/* success */
 	}
 
 end:
+	if(num_timed) {
+		st->dedup += tdedup * num_faces / num_timed;
+	}
 	mf_dynarr_free(varr);
 	mf_dynarr_free(narr);
 	mf_dynarr_free(tarr);
@@ -648,6 +688,7 @@ static int cmp_facevert(const void *ap, const void *bp)
 
 static void free_rbnode_key(struct rbnode *n, void *cls)
 {
+	MF_MEM_ACCT(MF_MEM_DEDUP, -(long)sizeof(struct facevertex));
 	free(n->key);
 }
 
@@ -841,7 +882,7 @@ int mf_save_obj(const struct mf_meshfile *mf, const struct mf_userio *io)
 	int i;
 	char *mtlpath, *fname, *suffix;
 	unsigned long voffs = 0;
-	struct mf_userio subio = {0};
+	struct mf_userio subio;
 
 	mf_fputs("# OBJ file written by libmeshfile: https://github.com/jtsiomb/meshfile\n", io);
 	mf_fputs("csh -xeyes\n", io);
@@ -862,32 +903,37 @@ int mf_save_obj(const struct mf_meshfile *mf, const struct mf_userio *io)
 		}
 		strcpy(mtlpath, fname);
 	}
-	if(!(suffix = strrchr(mtlpath, '.'))) {
+	if((suffix = strrchr(mtlpath, '.')) && mf_strcasecmp(suffix, ".gz") == 0) {
+		*suffix = 0;	/* foo.obj.gz -> foo.mtl */
+		suffix = strrchr(mtlpath, '.');
+	}
+	if(!suffix) {
 		suffix = mtlpath + strlen(mtlpath);
 	}
 	strcpy(suffix, ".mtl");
 
-	if(!(subio.file = io->open(mtlpath, "wb"))) {
+	if(mf_subio_open(&subio, io, mtlpath, "wb") == -1) {
 		fprintf(stderr, "failed to open %s for writing\n", mtlpath);
+		free(mtlpath);
 		goto geom;
 	}
-	subio.close = io->close;
-	subio.write = io->write;
 
 	for(i=0; i<mf_dynarr_size(mf->mtl); i++) {
 		if(write_material(mf->mtl[i], &subio) == -1) {
-			io->close(subio.file);
+			mf_subio_close(&subio);
+			free(mtlpath);
 			goto geom;
 		}
 	}
 
-	io->close(subio.file);
+	mf_subio_close(&subio);
 
 	mf_fprintf(io, "mtllib %s\n", basename(mtlpath));
+	free(mtlpath);
 
 geom:
 	for(i=0; i<mf_dynarr_size(mf->meshes); i++) {
-		if(write_mesh(mf->meshes[i], voffs, io) == -1) {
+		if(MF_CANCELLED(mf) || write_mesh(mf->meshes[i], voffs, io) == -1) {
 			return -1;
 		}
 		voffs += mf->meshes[i]->num_verts;
@@ -22,10 +22,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "util.h"
 
 
-static int read_float(float *ret, const struct mf_userio *io);
-static int read_vector(mf_vec3 *vec, const struct mf_userio *io);
-
-static int write_vec(mf_vec3 v, const struct mf_userio *io);
+static void put_vec(float *dest, mf_vec3 v);
 static int write_mesh(const struct mf_mesh *mesh, const float *mat, const struct mf_userio *io);
 
 int mf_load_stl(struct mf_meshfile *mf, const struct mf_userio *io)
@@ -34,7 +31,7 @@ int mf_load_stl(struct mf_meshfile *mf, const struct mf_userio *io)
 	uint32_t i, j, nfaces, vidx = 0;
 	struct mf_mesh *mesh = 0;
 	struct mf_node *node = 0;
-	mf_vec3 norm, vpos;
+	float rec[13], *vptr;	/* normal, 3 vertices, and the 16bit attribute word */
 
 	filesz = io->seek(io->file, 0, MF_SEEK_END);
 	io->seek(io->file, 80, MF_SEEK_SET);	/* skip header */
@@ -44,7 +41,11 @@ int mf_load_stl(struct mf_meshfile *mf, const struct mf_userio *io)
 	}
 	CONV_LE32(nfaces);
 
-	if(nfaces * 50 + 84 != filesz) {
+	if(filesz < 84 || (filesz - 84) % 50 || (unsigned long)(filesz - 84) / 50 != nfaces) {
+		return -1;
+	}
+	/* three vertices and normals, and a triangle per face */
+	if(MF_MEM_CHECK((unsigned long)nfaces * (6 * sizeof(mf_vec3) + sizeof(mf_face))) == -1) {
 		return -1;
 	}
 
@@ -62,20 +63,22 @@ int mf_load_stl(struct mf_meshfile *mf, const struct mf_userio *io)
 	}
 
 	for(i=0; i<nfaces; i++) {
-		if(read_vector(&norm, io) == -1) {
-			fprintf(stderr, "load_stl: failed to read normal\n");
+		if(MF_CANCELLED(mf)) {
+			goto err;
+		}
+		if(io->read(io->file, rec, 50) < 50) {
+			fprintf(stderr, "load_stl: failed to read face\n");
 			goto err;
 		}
+		mf_le32_array(rec, 12);
+
 		for(j=0; j<3; j++) {
-			if(mf_add_normal(mesh, norm.x, norm.y, norm.z) == -1) {
+			if(mf_add_normal(mesh, rec[0], rec[2], rec[1]) == -1) {
 				fprintf(stderr, "load_stl: failed to add normal\n");
 				goto err;
 			}
-			if(read_vector(&vpos, io) == -1) {
-				fprintf(stderr, "load_stl: failed to read vertex\n");
-				goto err;
-			}
-			if(mf_add_vertex(mesh, vpos.x, vpos.y, vpos.z) == -1) {
+			vptr = rec + 3 + j * 3;
+			if(mf_add_vertex(mesh, vptr[0], vptr[2], vptr[1]) == -1) {
 				fprintf(stderr, "load_stl: failed to add vertex\n");
 				goto err;
 			}
@@ -83,9 +86,9 @@ int mf_load_stl(struct mf_meshfile *mf, const struct mf_userio *io)
 
 		if(mf_add_triangle(mesh, vidx, vidx + 2, vidx + 1) == -1) {
 			fprintf(stderr, "load_stl: failed to add face\n");
+			goto err;
 		}
 		vidx += 3;
-		io->seek(io->file, 2, MF_SEEK_CUR);	/* skip attribute byte count */
 	}
 
 	if(mf_node_add_mesh(node, mesh) == -1) {
@@ -109,24 +112,6 @@ err:
 }
 
 
-static int read_float(float *ret, const struct mf_userio *io)
-{
-	if(io->read(io->file, ret, sizeof(float)) < sizeof(float)) {
-		return -1;
-	}
-	CONV_LEFLT(ret);
-	return 0;
-}
-
-static int read_vector(mf_vec3 *vec, const struct mf_userio *io)
-{
-	if(read_float(&vec->x, io) == -1 || read_float(&vec->z, io) == -1 ||
-			read_float(&vec->y, io) == -1) {
-		return -1;
-	}
-	return 0;
-}
-
 static const char id[] = "STL written by meshfile";
 int mf_save_stl(const struct mf_meshfile *mf, const struct mf_userio *io)
 {
@@ -159,6 +144,9 @@ int mf_save_stl(const struct mf_meshfile *mf, const struct mf_userio *io)
 	for(i=0; i<num_nodes; i++) {
 		node = mf_get_node(mf, i);
 		for(j=0; j<node->num_meshes; j++) {
+			if(MF_CANCELLED(mf)) {
+				return -1;
+			}
 			if(write_mesh(node->meshes[j], node->global_matrix, io) == -1) {
 				fprintf(stderr, "save_stl: failed to write mesh\n");
 				return -1;
@@ -168,21 +156,11 @@ int mf_save_stl(const struct mf_meshfile *mf, const struct mf_userio *io)
 	return 0;
 }
 
-static int write_vec(mf_vec3 v, const struct mf_userio *io)
+static void put_vec(float *dest, mf_vec3 v)
 {
-	CONV_LEFLT(v.x);
-	CONV_LEFLT(v.y);
-	CONV_LEFLT(v.z);
-	if(io->write(io->file, &v.x, sizeof v.x) < sizeof v.x) {
-		return -1;
-	}
-	if(io->write(io->file, &v.z, sizeof v.z) < sizeof v.z) {
-		return -1;
-	}
-	if(io->write(io->file, &v.y, sizeof v.y) < sizeof v.y) {
-		return -1;
-	}
-	return 0;
+	dest[0] = v.x;
+	dest[1] = v.z;
+	dest[2] = v.y;
 }
 
 static int write_mesh(const struct mf_mesh *mesh, const float *mat, const struct mf_userio *io)
@@ -190,7 +168,9 @@ static int write_mesh(const struct mf_mesh *mesh, const float *mat, const struct
 	unsigned int i, j;
 	mf_vec3 va, vb, v[3], norm;
 	struct mf_face *face;
-	static uint16_t zero;
+	float rec[13];	/* normal, 3 vertices, and a zero 16bit attribute word */
+
+	rec[12] = 0.0f;
 
 	for(i=0; i<mesh->num_faces; i++) {
 		face = mesh->faces + i;
@@ -202,13 +182,15 @@ static int write_mesh(const struct mf_mesh *mesh, const float *mat, const struct
 		mf_cross(&norm, &va, &vb);
 		mf_normalize(&norm);
 
-		if(write_vec(norm, io) == -1) {
+		/* assemble the whole record, and write it in one go */
+		put_vec(rec, norm);
+		put_vec(rec + 3, v[0]);
+		put_vec(rec + 6, v[2]);
+		put_vec(rec + 9, v[1]);
+		mf_le32_array(rec, 12);
+		if(io->write(io->file, rec, 50) < 50) {
 			return -1;
 		}
-		if(write_vec(v[0], io) == -1) return -1;
-		if(write_vec(v[2], io) == -1) return -1;
-		if(write_vec(v[1], io) == -1) return -1;
-		io->write(io->file, &zero, 2);
 	}
 	return 0;
 }
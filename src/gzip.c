@@ -0,0 +1,916 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gzip.h"
+#include "mfpriv.h"
+
+#define INBUF_SIZE	16384
+#define OUTBUF_SIZE	16384
+#define WSIZE		32768
+#define WMASK		(WSIZE - 1)
+#define FASTBITS	9
+
+#define HASH_BITS	15
+#define HASH_SIZE	(1 << HASH_BITS)
+#define MAX_CHAIN	64
+#define MIN_MATCH	3
+#define MAX_MATCH	258
+
+/* gzip header flags */
+#define FHCRC		0x02
+#define FEXTRA		0x04
+#define FNAME		0x08
+#define FCOMMENT	0x10
+
+enum { ST_MEMBER, ST_BLOCK, ST_STORED, ST_HUFF, ST_TRAILER, ST_END, ST_ERR };
+
+struct huff {
+	uint16_t fast[1 << FASTBITS];	/* (sym << 4) | len, 0 for longer codes */
+	uint16_t count[16];
+	uint16_t sym[288];
+};
+
+struct gzrd {
+	struct mf_userio io;
+	long start;			/* offset of the gzip stream in io */
+
+	unsigned char inbuf[INBUF_SIZE];
+	int inpos, inlen;
+	uint32_t bitbuf;
+	int bitcnt;
+
+	int state, last;
+	long stored_left;
+	int match_len, match_dist;
+	struct huff lit, dist;
+
+	unsigned char window[WSIZE];
+	long outpos;		/* decompressed bytes so far */
+	long pos;			/* logical read position, we catch up on the next read */
+	long isize;			/* uncompressed size from the trailer, -1 if unknown */
+	uint32_t crc;
+};
+
+struct gzwr {
+	struct mf_userio io;
+	unsigned char *buf;
+	long size, max_size, pos;
+};
+
+/* deflate compressor state */
+struct gzenc {
+	const struct mf_userio *io;
+	unsigned char outbuf[OUTBUF_SIZE];
+	int outlen;
+	uint32_t bitbuf;
+	int bitcnt;
+	int err;
+};
+
+static void *gz_open(const char *fname, const char *mode);
+static void gz_close(void *file);
+static int gz_read(void *file, void *buf, int sz);
+static int gz_write(void *file, const void *buf, int sz);
+static long gz_seek(void *file, long offs, int from);
+static int gzwr_write(void *file, const void *buf, int sz);
+static long gzwr_seek(void *file, long offs, int from);
+
+static void restart(struct gzrd *gz);
+static int inflate(struct gzrd *gz, unsigned char *dest, int sz);
+static long read_isize(struct gzrd *gz);
+static int deflate(const unsigned char *src, long size, const struct mf_userio *io);
+
+static uint32_t crc32(uint32_t crc, const unsigned char *data, long size);
+
+static const uint16_t lbase[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const unsigned char lext[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dbase[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const unsigned char dext[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+
+int mf_gzip_check(const struct mf_userio *io)
+{
+	unsigned char magic[3];
+	long fpos;
+	int res;
+
+	if((fpos = io->seek(io->file, 0, MF_SEEK_CUR)) == -1) {
+		return 0;
+	}
+	res = io->read(io->file, magic, 3) == 3 && magic[0] == 0x1f && magic[1] == 0x8b &&
+		magic[2] == 8;
+	io->seek(io->file, fpos, MF_SEEK_SET);
+	return res;
+}
+
+int mf_gzip_rdopen(struct mf_userio *gzio, const struct mf_userio *io)
+{
+	struct gzrd *gz;
+
+	if(!(gz = calloc(1, sizeof *gz))) {
+		fprintf(stderr, "mf_gzip_rdopen: failed to allocate decompressor\n");
+		return -1;
+	}
+	gz->io = *io;
+	if((gz->start = io->seek(io->file, 0, MF_SEEK_CUR)) == -1) {
+		gz->start = 0;
+	}
+	gz->isize = -1;
+	restart(gz);
+
+	memset(gzio, 0, sizeof *gzio);
+	gzio->file = gz;
+	gzio->open = io->open ? gz_open : 0;
+	gzio->close = gz_close;
+	gzio->read = gz_read;
+	gzio->write = gz_write;
+	gzio->seek = gz_seek;
+	return 0;
+}
+
+void mf_gzip_rdclose(struct mf_userio *gzio)
+{
+	free(gzio->file);
+	gzio->file = 0;
+}
+
+int mf_gzip_wropen(struct mf_userio *gzio, const struct mf_userio *io)
+{
+	struct gzwr *gz;
+
+	if(!(gz = calloc(1, sizeof *gz))) {
+		fprintf(stderr, "mf_gzip_wropen: failed to allocate compressor\n");
+		return -1;
+	}
+	gz->io = *io;
+
+	memset(gzio, 0, sizeof *gzio);
+	gzio->file = gz;
+	gzio->open = io->open ? gz_open : 0;
+	gzio->close = gz_close;
+	gzio->write = gzwr_write;
+	gzio->seek = gzwr_seek;
+	return 0;
+}
+
+int mf_gzip_wrclose(struct mf_userio *gzio)
+{
+	int res;
+	struct gzwr *gz = gzio->file;
+
+	res = deflate(gz->buf, gz->size, &gz->io);
+	free(gz->buf);
+	free(gz);
+	gzio->file = 0;
+	return res;
+}
+
+const struct mf_userio *mf_gzip_userio(const struct mf_userio *gzio)
+{
+	if(gzio->read == gz_read) {
+		return &((struct gzrd*)gzio->file)->io;
+	}
+	if(gzio->write == gzwr_write) {
+		return &((struct gzwr*)gzio->file)->io;
+	}
+	return 0;
+}
+
+static void *gz_open(const char *fname, const char *mode)
+{
+	/* auxiliary files must be opened with mf_subio_open */
+	return 0;
+}
+
+static void gz_close(void *file)
+{
+}
+
+static int gz_read(void *file, void *buf, int sz)
+{
+	struct gzrd *gz = file;
+	unsigned char dummy[1024];
+	int len, rd;
+
+	if(gz->pos < gz->outpos) {
+		/* no way to go back in a deflate stream, start over */
+		gz->io.seek(gz->io.file, gz->start, MF_SEEK_SET);
+		restart(gz);
+	}
+	while(gz->outpos < gz->pos) {
+		len = gz->pos - gz->outpos;
+		if(len > (int)sizeof dummy) len = sizeof dummy;
+		if(inflate(gz, dummy, len) <= 0) {
+			return -1;
+		}
+	}
+
+	if((rd = inflate(gz, buf, sz)) <= 0) {
+		return -1;
+	}
+	gz->pos = gz->outpos;
+	return rd;
+}
+
+static int gz_write(void *file, const void *buf, int sz)
+{
+	return -1;
+}
+
+static long gz_seek(void *file, long offs, int from)
+{
+	struct gzrd *gz = file;
+	long pos;
+
+	switch(from) {
+	case MF_SEEK_SET:
+		pos = offs;
+		break;
+	case MF_SEEK_CUR:
+		pos = gz->pos + offs;
+		break;
+	case MF_SEEK_END:
+		if(gz->isize < 0 && (gz->isize = read_isize(gz)) < 0) {
+			return -1;
+		}
+		pos = gz->isize + offs;
+		break;
+	default:
+		return -1;
+	}
+	if(pos < 0) return -1;
+
+	/* the actual skipping happens lazily on the next read */
+	gz->pos = pos;
+	return pos;
+}
+
+static int gzwr_write(void *file, const void *buf, int sz)
+{
+	struct gzwr *gz = file;
+	long newsz;
+	void *tmp;
+
+	if(gz->pos + sz > gz->max_size) {
+		newsz = gz->max_size ? gz->max_size * 2 : 65536;
+		while(newsz < gz->pos + sz) newsz *= 2;
+		if(!(tmp = realloc(gz->buf, newsz))) {
+			fprintf(stderr, "gzip: failed to resize output buffer (%ld bytes)\n", newsz);
+			return -1;
+		}
+		gz->buf = tmp;
+		gz->max_size = newsz;
+	}
+	if(gz->pos > gz->size) {
+		memset(gz->buf + gz->size, 0, gz->pos - gz->size);
+	}
+	memcpy(gz->buf + gz->pos, buf, sz);
+	gz->pos += sz;
+	if(gz->pos > gz->size) {
+		gz->size = gz->pos;
+	}
+	return sz;
+}
+
+static long gzwr_seek(void *file, long offs, int from)
+{
+	struct gzwr *gz = file;
+	long pos;
+
+	switch(from) {
+	case MF_SEEK_SET:
+		pos = offs;
+		break;
+	case MF_SEEK_CUR:
+		pos = gz->pos + offs;
+		break;
+	case MF_SEEK_END:
+		pos = gz->size + offs;
+		break;
+	default:
+		return -1;
+	}
+	if(pos < 0) return -1;
+	gz->pos = pos;
+	return pos;
+}
+
+
+/* ---- decompressor ---- */
+
+static void restart(struct gzrd *gz)
+{
+	gz->inpos = gz->inlen = 0;
+	gz->bitbuf = 0;
+	gz->bitcnt = 0;
+	gz->state = ST_MEMBER;
+	gz->last = 0;
+	gz->match_len = 0;
+	gz->outpos = 0;
+	gz->crc = 0;
+}
+
+static int getbyte(struct gzrd *gz)
+{
+	if(gz->inpos >= gz->inlen) {
+		if((gz->inlen = gz->io.read(gz->io.file, gz->inbuf, INBUF_SIZE)) <= 0) {
+			gz->inlen = 0;
+			return -1;
+		}
+		gz->inpos = 0;
+	}
+	return gz->inbuf[gz->inpos++];
+}
+
+static int fillbits(struct gzrd *gz, int n)
+{
+	int c;
+	while(gz->bitcnt < n) {
+		if((c = getbyte(gz)) == -1) {
+			return -1;
+		}
+		gz->bitbuf |= (uint32_t)c << gz->bitcnt;
+		gz->bitcnt += 8;
+	}
+	return 0;
+}
+
+static int getbits(struct gzrd *gz, int n)
+{
+	int val;
+
+	if(!n) return 0;
+	if(fillbits(gz, n) == -1) {
+		gz->state = ST_ERR;
+		return 0;
+	}
+	val = gz->bitbuf & ((1 << n) - 1);
+	gz->bitbuf >>= n;
+	gz->bitcnt -= n;
+	return val;
+}
+
+static void alignbits(struct gzrd *gz)
+{
+	gz->bitbuf >>= gz->bitcnt & 7;
+	gz->bitcnt &= ~7;
+}
+
+static int build_huff(struct huff *h, const unsigned char *lengths, int n)
+{
+	int i, j, len, left;
+	uint16_t offs[16], code, next_code[16], rev;
+
+	memset(h->count, 0, sizeof h->count);
+	memset(h->fast, 0, sizeof h->fast);
+	for(i=0; i<n; i++) {
+		h->count[lengths[i]]++;
+	}
+	h->count[0] = 0;
+
+	/* check for an over-subscribed code */
+	left = 1;
+	for(i=1; i<16; i++) {
+		left = (left << 1) - h->count[i];
+		if(left < 0) return -1;
+	}
+
+	offs[1] = 0;
+	for(i=1; i<15; i++) {
+		offs[i + 1] = offs[i] + h->count[i];
+	}
+	next_code[1] = 0;
+	for(i=2; i<16; i++) {
+		next_code[i] = (next_code[i - 1] + h->count[i - 1]) << 1;
+	}
+
+	for(i=0; i<n; i++) {
+		if(!(len = lengths[i])) continue;
+		h->sym[offs[len]++] = i;
+
+		code = next_code[len]++;
+		if(len <= FASTBITS) {
+			rev = 0;
+			for(j=0; j<len; j++) {
+				rev = (rev << 1) | ((code >> j) & 1);
+			}
+			for(j=rev; j<(1 << FASTBITS); j+=1 << len) {
+				h->fast[j] = (i << 4) | len;
+			}
+		}
+	}
+	return 0;
+}
+
+static int decode(struct gzrd *gz, struct huff *h)
+{
+	int len, code, first, count, idx, e;
+
+	/* fast path, works as long as there are enough bits left in the input */
+	fillbits(gz, FASTBITS);
+	if((e = h->fast[gz->bitbuf & ((1 << FASTBITS) - 1)]) && (e & 15) <= gz->bitcnt) {
+		gz->bitbuf >>= e & 15;
+		gz->bitcnt -= e & 15;
+		return e >> 4;
+	}
+
+	code = first = idx = 0;
+	for(len=1; len<16; len++) {
+		code |= getbits(gz, 1);
+		if(gz->state == ST_ERR) return -1;
+		count = h->count[len];
+		if(code - count < first) {
+			return h->sym[idx + (code - first)];
+		}
+		idx += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+static int read_member_header(struct gzrd *gz)
+{
+	int i, flags, len;
+
+	if(getbits(gz, 8) != 0x1f || getbits(gz, 8) != 0x8b || getbits(gz, 8) != 8) {
+		return -1;
+	}
+	flags = getbits(gz, 8);
+	for(i=0; i<6; i++) {
+		getbits(gz, 8);		/* mtime, xfl, os */
+	}
+	if(flags & FEXTRA) {
+		len = getbits(gz, 16);
+		while(len-- > 0 && gz->state != ST_ERR) {
+			getbits(gz, 8);
+		}
+	}
+	if(flags & FNAME) {
+		while(getbits(gz, 8) && gz->state != ST_ERR);
+	}
+	if(flags & FCOMMENT) {
+		while(getbits(gz, 8) && gz->state != ST_ERR);
+	}
+	if(flags & FHCRC) {
+		getbits(gz, 16);
+	}
+	return gz->state == ST_ERR ? -1 : 0;
+}
+
+static int read_dynamic_tables(struct gzrd *gz)
+{
+	static const unsigned char clorder[] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13,
+		2, 14, 1, 15};
+	int i, sym, nlit, ndist, nclen, rep, prev;
+	unsigned char lengths[320];
+
+	nlit = getbits(gz, 5) + 257;
+	ndist = getbits(gz, 5) + 1;
+	nclen = getbits(gz, 4) + 4;
+	if(nlit > 286 || ndist > 30) return -1;
+
+	memset(lengths, 0, sizeof lengths);
+	for(i=0; i<nclen; i++) {
+		lengths[clorder[i]] = getbits(gz, 3);
+	}
+	if(build_huff(&gz->lit, lengths, 19) == -1) return -1;
+
+	i = 0;
+	while(i < nlit + ndist) {
+		if((sym = decode(gz, &gz->lit)) < 0) return -1;
+		if(sym < 16) {
+			lengths[i++] = sym;
+			continue;
+		}
+		prev = 0;
+		if(sym == 16) {
+			if(!i) return -1;
+			prev = lengths[i - 1];
+			rep = 3 + getbits(gz, 2);
+		} else if(sym == 17) {
+			rep = 3 + getbits(gz, 3);
+		} else {
+			rep = 11 + getbits(gz, 7);
+		}
+		if(i + rep > nlit + ndist) return -1;
+		while(rep-- > 0) {
+			lengths[i++] = prev;
+		}
+	}
+	if(gz->state == ST_ERR) return -1;
+
+	if(build_huff(&gz->lit, lengths, nlit) == -1) return -1;
+	if(build_huff(&gz->dist, lengths + nlit, ndist) == -1) return -1;
+	return 0;
+}
+
+static void fixed_tables(struct gzrd *gz)
+{
+	int i;
+	unsigned char lengths[288];
+
+	for(i=0; i<144; i++) lengths[i] = 8;
+	for(; i<256; i++) lengths[i] = 9;
+	for(; i<280; i++) lengths[i] = 7;
+	for(; i<288; i++) lengths[i] = 8;
+	build_huff(&gz->lit, lengths, 288);
+
+	for(i=0; i<30; i++) lengths[i] = 5;
+	build_huff(&gz->dist, lengths, 30);
+}
+
+static int read_trailer(struct gzrd *gz)
+{
+	uint32_t crc, isize;
+
+	alignbits(gz);
+	crc = getbits(gz, 16);
+	crc |= (uint32_t)getbits(gz, 16) << 16;
+	isize = getbits(gz, 16);
+	isize |= (uint32_t)getbits(gz, 16) << 16;
+	if(gz->state == ST_ERR) return -1;
+
+	if(crc != gz->crc) {
+		fprintf(stderr, "gzip: CRC mismatch, the file is corrupted\n");
+		return -1;
+	}
+	(void)isize;
+	return 0;
+}
+
+#define PUT(c) \
+	do { \
+		gz->window[gz->outpos++ & WMASK] = (c); \
+		*dest++ = (c); \
+		count++; \
+	} while(0)
+
+/* decompress up to sz bytes, returns the number of bytes produced, 0 at the end
+ * of the stream, or -1 on error.
+ */
+static int inflate(struct gzrd *gz, unsigned char *dest, int sz)
+{
+	int sym, btype, count = 0;
+	unsigned int len, nlen;
+	unsigned char c, *start = dest;
+
+	while(count < sz) {
+		if(gz->match_len > 0) {
+			c = gz->window[(gz->outpos - gz->match_dist) & WMASK];
+			PUT(c);
+			gz->match_len--;
+			continue;
+		}
+
+		switch(gz->state) {
+		case ST_MEMBER:
+			if(read_member_header(gz) == -1) {
+				if(gz->outpos > 0) {
+					/* no more members, ignore any trailing garbage */
+					gz->state = ST_END;
+					break;
+				}
+				fprintf(stderr, "gzip: invalid header\n");
+				gz->state = ST_ERR;
+				break;
+			}
+			gz->crc = 0;
+			gz->state = ST_BLOCK;
+			break;
+
+		case ST_BLOCK:
+			if(gz->last) {
+				gz->state = ST_TRAILER;
+				break;
+			}
+			gz->last = getbits(gz, 1);
+			btype = getbits(gz, 2);
+			if(btype == 0) {
+				alignbits(gz);
+				len = getbits(gz, 16);
+				nlen = getbits(gz, 16);
+				if((len ^ 0xffff) != nlen) {
+					fprintf(stderr, "gzip: corrupted stored block\n");
+					gz->state = ST_ERR;
+					break;
+				}
+				gz->stored_left = len;
+				gz->state = ST_STORED;
+			} else if(btype == 1) {
+				fixed_tables(gz);
+				gz->state = ST_HUFF;
+			} else if(btype == 2) {
+				if(read_dynamic_tables(gz) == -1) {
+					fprintf(stderr, "gzip: invalid huffman tables\n");
+					gz->state = ST_ERR;
+					break;
+				}
+				gz->state = ST_HUFF;
+			} else {
+				fprintf(stderr, "gzip: invalid block type\n");
+				gz->state = ST_ERR;
+			}
+			break;
+
+		case ST_STORED:
+			if(gz->stored_left <= 0) {
+				gz->state = ST_BLOCK;
+				break;
+			}
+			c = getbits(gz, 8);
+			PUT(c);
+			gz->stored_left--;
+			break;
+
+		case ST_HUFF:
+			if((sym = decode(gz, &gz->lit)) < 0) {
+				gz->state = ST_ERR;
+				break;
+			}
+			if(sym < 256) {
+				c = sym;
+				PUT(c);
+			} else if(sym == 256) {
+				gz->state = ST_BLOCK;
+			} else {
+				sym -= 257;
+				if(sym >= 29) {
+					gz->state = ST_ERR;
+					break;
+				}
+				gz->match_len = lbase[sym] + getbits(gz, lext[sym]);
+				if((sym = decode(gz, &gz->dist)) < 0 || sym >= 30) {
+					gz->state = ST_ERR;
+					break;
+				}
+				gz->match_dist = dbase[sym] + getbits(gz, dext[sym]);
+				if(gz->match_dist > gz->outpos) {
+					fprintf(stderr, "gzip: invalid match distance\n");
+					gz->state = ST_ERR;
+				}
+			}
+			break;
+
+		case ST_TRAILER:
+			gz->crc = crc32(gz->crc, start, dest - start);
+			start = dest;
+			if(read_trailer(gz) == -1) {
+				gz->state = ST_ERR;
+				break;
+			}
+			/* concatenated gzip members are allowed */
+			gz->state = ST_MEMBER;
+			gz->last = 0;
+			break;
+
+		case ST_END:
+			goto end;
+
+		case ST_ERR:
+		default:
+			break;
+		}
+
+		if(gz->state == ST_ERR) {
+			/* return what we've got so far, and fail on the next call */
+			gz->match_len = 0;
+			if(!count) return -1;
+			break;
+		}
+	}
+
+end:
+	gz->crc = crc32(gz->crc, start, dest - start);
+	return count;
+}
+
+static long read_isize(struct gzrd *gz)
+{
+	long fpos;
+	unsigned char buf[4];
+
+	fpos = gz->io.seek(gz->io.file, 0, MF_SEEK_CUR);
+	if(gz->io.seek(gz->io.file, -4, MF_SEEK_END) == -1 ||
+			gz->io.read(gz->io.file, buf, 4) != 4) {
+		gz->io.seek(gz->io.file, fpos, MF_SEEK_SET);
+		return -1;
+	}
+	gz->io.seek(gz->io.file, fpos, MF_SEEK_SET);
+
+	/* only accurate for single member files under 4GB, which covers every
+	 * file we'd write ourselves.
+	 */
+	return (long)buf[0] | ((long)buf[1] << 8) | ((long)buf[2] << 16) | ((long)buf[3] << 24);
+}
+
+
+/* ---- compressor ---- */
+
+static void flush_out(struct gzenc *d)
+{
+	int wr;
+	unsigned char *ptr = d->outbuf;
+
+	while(d->outlen > 0 && !d->err) {
+		if((wr = d->io->write(d->io->file, ptr, d->outlen)) <= 0) {
+			d->err = 1;
+			break;
+		}
+		ptr += wr;
+		d->outlen -= wr;
+	}
+	d->outlen = 0;
+}
+
+static void putbyte(struct gzenc *d, int c)
+{
+	if(d->outlen >= OUTBUF_SIZE) {
+		flush_out(d);
+	}
+	d->outbuf[d->outlen++] = c;
+}
+
+static void putbits(struct gzenc *d, unsigned int val, int n)
+{
+	d->bitbuf |= (uint32_t)val << d->bitcnt;
+	d->bitcnt += n;
+	while(d->bitcnt >= 8) {
+		putbyte(d, d->bitbuf & 0xff);
+		d->bitbuf >>= 8;
+		d->bitcnt -= 8;
+	}
+}
+
+/* huffman codes are packed starting from the most significant bit */
+static void putcode(struct gzenc *d, unsigned int code, int n)
+{
+	int i;
+	unsigned int rev = 0;
+
+	for(i=0; i<n; i++) {
+		rev = (rev << 1) | ((code >> i) & 1);
+	}
+	putbits(d, rev, n);
+}
+
+static void put_litlen(struct gzenc *d, int sym)
+{
+	if(sym < 144) {
+		putcode(d, 0x30 + sym, 8);
+	} else if(sym < 256) {
+		putcode(d, 0x190 + sym - 144, 9);
+	} else if(sym < 280) {
+		putcode(d, sym - 256, 7);
+	} else {
+		putcode(d, 0xc0 + sym - 280, 8);
+	}
+}
+
+static void put_match(struct gzenc *d, int len, int dist)
+{
+	int i;
+
+	for(i=28; lbase[i] > len; i--);
+	put_litlen(d, 257 + i);
+	putbits(d, len - lbase[i], lext[i]);
+
+	for(i=29; dbase[i] > dist; i--);
+	putcode(d, i, 5);
+	putbits(d, dist - dbase[i], dext[i]);
+}
+
+#define HASH(p)	((((p)[0] << 10) ^ ((p)[1] << 5) ^ (p)[2]) & (HASH_SIZE - 1))
+
+/* single fixed-huffman block, with greedy LZ77 matching over hash chains */
+static int deflate(const unsigned char *src, long size, const struct mf_userio *io)
+{
+	static const unsigned char hdr[] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+	struct gzenc *d;
+	long i, j, cand, *head, *prev;
+	int k, len, maxlen, best_len, best_dist, chain;
+	uint32_t crc;
+
+	d = malloc(sizeof *d);
+	head = malloc(HASH_SIZE * sizeof *head);
+	prev = malloc(WSIZE * sizeof *prev);
+	if(!d || !head || !prev) {
+		fprintf(stderr, "gzip: failed to allocate compressor\n");
+		free(d);
+		free(head);
+		free(prev);
+		return -1;
+	}
+	d->io = io;
+	d->outlen = 0;
+	d->bitbuf = 0;
+	d->bitcnt = 0;
+	d->err = 0;
+	for(i=0; i<HASH_SIZE; i++) {
+		head[i] = -1;
+	}
+
+	for(k=0; k<(int)sizeof hdr; k++) {
+		putbyte(d, hdr[k]);
+	}
+	putbits(d, 1, 1);	/* final block */
+	putbits(d, 1, 2);	/* fixed huffman codes */
+
+	i = 0;
+	while(i < size) {
+		best_len = best_dist = 0;
+		if(i + MIN_MATCH <= size) {
+			maxlen = size - i < MAX_MATCH ? size - i : MAX_MATCH;
+			cand = head[HASH(src + i)];
+			chain = MAX_CHAIN;
+			while(cand >= 0 && i - cand <= WSIZE && chain-- > 0) {
+				if(src[cand + best_len] == src[i + best_len]) {
+					for(len=0; len<maxlen && src[cand + len] == src[i + len]; len++);
+					if(len > best_len) {
+						best_len = len;
+						best_dist = i - cand;
+						if(len == maxlen) break;
+					}
+				}
+				j = prev[cand & WMASK];
+				if(j >= cand) break;	/* stale link, overwritten by a later position */
+				cand = j;
+			}
+		}
+
+		if(best_len >= MIN_MATCH) {
+			put_match(d, best_len, best_dist);
+		} else {
+			best_len = 1;
+			put_litlen(d, src[i]);
+		}
+
+		/* add all positions covered to the hash chains */
+		for(j=i; j<i + best_len; j++) {
+			if(j + MIN_MATCH <= size) {
+				k = HASH(src + j);
+				prev[j & WMASK] = head[k];
+				head[k] = j;
+			}
+		}
+		i += best_len;
+	}
+	put_litlen(d, 256);
+	if(d->bitcnt > 0) {
+		putbits(d, 0, 8 - d->bitcnt);
+	}
+
+	crc = crc32(0, src, size);
+	for(k=0; k<4; k++) {
+		putbyte(d, (crc >> (k * 8)) & 0xff);
+	}
+	for(k=0; k<4; k++) {
+		putbyte(d, (size >> (k * 8)) & 0xff);
+	}
+	flush_out(d);
+
+	k = d->err ? -1 : 0;
+	free(d);
+	free(head);
+	free(prev);
+	return k;
+}
+
+static uint32_t crc32(uint32_t crc, const unsigned char *data, long size)
+{
+	static const uint32_t tab[] = {
+		0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4,
+		0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+		0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+	};
+
+	crc = ~crc;
+	while(size-- > 0) {
+		crc ^= *data++;
+		crc = (crc >> 4) ^ tab[crc & 15];
+		crc = (crc >> 4) ^ tab[crc & 15];
+	}
+	return ~crc;
+}
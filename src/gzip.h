@@ -0,0 +1,45 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef GZIP_H_
+#define GZIP_H_
+
+#include "meshfile.h"
+
+/* gzip (DEFLATE) compressed streams, layered on top of a set of user I/O
+ * callbacks.
+ *
+ * The reader decompresses on the fly. Seeking forward skips over decompressed
+ * data, and seeking backwards restarts decompression from the beginning, so
+ * it's best to keep seeks within a buffered reader on top of this. Seeking
+ * relative to the end relies on the size field of the gzip trailer.
+ *
+ * The writer keeps the whole uncompressed output in memory, to allow writers
+ * to seek around freely, and compresses it to io in mf_gzip_wrclose.
+ */
+int mf_gzip_check(const struct mf_userio *io);
+
+int mf_gzip_rdopen(struct mf_userio *gzio, const struct mf_userio *io);
+void mf_gzip_rdclose(struct mf_userio *gzio);
+
+int mf_gzip_wropen(struct mf_userio *gzio, const struct mf_userio *io);
+int mf_gzip_wrclose(struct mf_userio *gzio);
+
+/* returns the underlying I/O callbacks if gzio is a gzip stream, or null */
+const struct mf_userio *mf_gzip_userio(const struct mf_userio *gzio);
+
+#endif	/* GZIP_H_ */
@@ -0,0 +1,260 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "iouring.h"
+
+#ifdef MF_IO_URING
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define LOAD_ACQ(x)		__atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define STORE_REL(x, v)	__atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+
+struct mf_ioring {
+	int fd, depth;
+	int nqueued, ninflight;
+
+	void *sqring, *cqring;
+	size_t sqring_size, cqring_size, sqes_size;
+
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	struct io_uring_sqe *sqes;
+
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+};
+
+static int sys_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned int nsub, unsigned int mincompl, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, nsub, mincompl, flags, 0, 0);
+}
+
+struct mf_ioring *mf_ioring_create(int depth)
+{
+	struct mf_ioring *ring;
+	struct io_uring_params p;
+	char *sq, *cq;
+
+	if(!(ring = calloc(1, sizeof *ring))) {
+		return 0;
+	}
+	ring->sqring = ring->cqring = MAP_FAILED;
+	ring->sqes = MAP_FAILED;
+
+	memset(&p, 0, sizeof p);
+	if((ring->fd = sys_setup(depth, &p)) == -1) {
+		/* not supported by the kernel, or blocked by a seccomp policy */
+		free(ring);
+		return 0;
+	}
+	ring->depth = p.sq_entries;
+	if(p.cq_entries < p.sq_entries) {
+		ring->depth = p.cq_entries;
+	}
+
+	ring->sqring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->cqring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP) {
+		if(ring->cqring_size > ring->sqring_size) {
+			ring->sqring_size = ring->cqring_size;
+		}
+		ring->cqring_size = ring->sqring_size;
+	}
+
+	ring->sqring = mmap(0, ring->sqring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			ring->fd, IORING_OFF_SQ_RING);
+	if(ring->sqring == MAP_FAILED) goto err;
+
+	if(p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cqring = ring->sqring;
+	} else {
+		ring->cqring = mmap(0, ring->cqring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				ring->fd, IORING_OFF_CQ_RING);
+		if(ring->cqring == MAP_FAILED) goto err;
+	}
+
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(0, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			ring->fd, IORING_OFF_SQES);
+	if(ring->sqes == MAP_FAILED) goto err;
+
+	sq = ring->sqring;
+	ring->sq_head = (unsigned int*)(sq + p.sq_off.head);
+	ring->sq_tail = (unsigned int*)(sq + p.sq_off.tail);
+	ring->sq_mask = (unsigned int*)(sq + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned int*)(sq + p.sq_off.array);
+
+	cq = ring->cqring;
+	ring->cq_head = (unsigned int*)(cq + p.cq_off.head);
+	ring->cq_tail = (unsigned int*)(cq + p.cq_off.tail);
+	ring->cq_mask = (unsigned int*)(cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+	return ring;
+
+err:
+	mf_ioring_destroy(ring);
+	return 0;
+}
+
+void mf_ioring_destroy(struct mf_ioring *ring)
+{
+	if(!ring) return;
+
+	if(ring->sqes != MAP_FAILED) {
+		munmap(ring->sqes, ring->sqes_size);
+	}
+	if(ring->cqring != MAP_FAILED && ring->cqring != ring->sqring) {
+		munmap(ring->cqring, ring->cqring_size);
+	}
+	if(ring->sqring != MAP_FAILED) {
+		munmap(ring->sqring, ring->sqring_size);
+	}
+	close(ring->fd);
+	free(ring);
+}
+
+int mf_ioring_space(struct mf_ioring *ring)
+{
+	/* never have more reads in flight than completion queue entries */
+	return ring->depth - ring->nqueued - ring->ninflight;
+}
+
+int mf_ioring_read(struct mf_ioring *ring, int fd, void *buf, unsigned int sz, long offs,
+		void *udata)
+{
+	unsigned int tail, idx;
+	struct io_uring_sqe *sqe;
+
+	if(mf_ioring_space(ring) <= 0) {
+		return -1;
+	}
+
+	tail = *ring->sq_tail;
+	idx = tail & *ring->sq_mask;
+	sqe = ring->sqes + idx;
+
+	memset(sqe, 0, sizeof *sqe);
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long)buf;
+	sqe->len = sz;
+	sqe->off = offs;
+	sqe->user_data = (unsigned long)udata;
+
+	ring->sq_array[idx] = idx;
+	STORE_REL(*ring->sq_tail, tail + 1);
+	ring->nqueued++;
+	return 0;
+}
+
+int mf_ioring_submit(struct mf_ioring *ring)
+{
+	int res;
+
+	while(ring->nqueued > 0) {
+		if((res = sys_enter(ring->fd, ring->nqueued, 0, 0)) == -1) {
+			if(errno == EINTR || errno == EAGAIN) continue;
+			return -1;
+		}
+		ring->nqueued -= res;
+		ring->ninflight += res;
+	}
+	return 0;
+}
+
+int mf_ioring_pending(struct mf_ioring *ring)
+{
+	return ring->nqueued + ring->ninflight;
+}
+
+void *mf_ioring_wait(struct mf_ioring *ring, int *res)
+{
+	unsigned int head;
+	struct io_uring_cqe *cqe;
+	void *udata;
+
+	if(ring->ninflight <= 0 && mf_ioring_submit(ring) == -1) {
+		return 0;
+	}
+	if(ring->ninflight <= 0) {
+		return 0;
+	}
+
+	head = *ring->cq_head;
+	while(head == LOAD_ACQ(*ring->cq_tail)) {
+		if(sys_enter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS) == -1 && errno != EINTR) {
+			return 0;
+		}
+	}
+
+	cqe = ring->cqes + (head & *ring->cq_mask);
+	udata = (void*)(unsigned long)cqe->user_data;
+	*res = cqe->res;
+	STORE_REL(*ring->cq_head, head + 1);
+	ring->ninflight--;
+	return udata;
+}
+
+#else	/* !MF_IO_URING */
+
+struct mf_ioring *mf_ioring_create(int depth)
+{
+	return 0;
+}
+
+void mf_ioring_destroy(struct mf_ioring *ring)
+{
+}
+
+int mf_ioring_space(struct mf_ioring *ring)
+{
+	return 0;
+}
+
+int mf_ioring_read(struct mf_ioring *ring, int fd, void *buf, unsigned int sz, long offs,
+		void *udata)
+{
+	return -1;
+}
+
+int mf_ioring_submit(struct mf_ioring *ring)
+{
+	return -1;
+}
+
+int mf_ioring_pending(struct mf_ioring *ring)
+{
+	return 0;
+}
+
+void *mf_ioring_wait(struct mf_ioring *ring, int *res)
+{
+	return 0;
+}
+
+#endif	/* MF_IO_URING */
@@ -0,0 +1,49 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef IOURING_H_
+#define IOURING_H_
+
+/* minimal io_uring interface, used by mf_load_batch to keep many large reads
+ * in flight. Only available on Linux when built with MF_IO_URING, otherwise
+ * mf_ioring_create always fails, and callers should fall back to regular I/O.
+ */
+struct mf_ioring;
+
+struct mf_ioring *mf_ioring_create(int depth);
+void mf_ioring_destroy(struct mf_ioring *ring);
+
+/* returns the number of submission slots still available */
+int mf_ioring_space(struct mf_ioring *ring);
+
+/* queue a read of sz bytes at offset offs from file descriptor fd. Returns -1
+ * if the submission queue is full.
+ */
+int mf_ioring_read(struct mf_ioring *ring, int fd, void *buf, unsigned int sz, long offs,
+		void *udata);
+/* submit all queued reads to the kernel */
+int mf_ioring_submit(struct mf_ioring *ring);
+
+/* number of reads queued or submitted, which haven't been waited for yet */
+int mf_ioring_pending(struct mf_ioring *ring);
+
+/* wait for the next completion, and return its udata. The result of the read
+ * (number of bytes, or -errno) is written to res.
+ */
+void *mf_ioring_wait(struct mf_ioring *ring, int *res);
+
+#endif	/* IOURING_H_ */
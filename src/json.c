@@ -13,6 +13,7 @@
 #endif
 
 #include "json.h"
+#include "mfpriv.h"
 
 #ifdef _MSC_VER
 #define strncasecmp strnicmp
@@ -26,6 +27,7 @@ struct json_obj *json_alloc_obj(void)
 		fprintf(stderr, "json_alloc_obj: failed to allocate object\n");
 		return 0;
 	}
+	MF_MEM_ACCT(MF_MEM_JSON, sizeof *obj);
 	json_init_obj(obj);
 	return obj;
 }
@@ -33,6 +35,7 @@ struct json_obj *json_alloc_obj(void)
 void json_free_obj(struct json_obj *obj)
 {
 	json_destroy_obj(obj);
+	MF_MEM_ACCT(MF_MEM_JSON, -(long)sizeof *obj);
 	free(obj);
 }
 
@@ -48,6 +51,7 @@ void json_destroy_obj(struct json_obj *obj)
 	for(i=0; i<obj->num_items; i++) {
 		json_destroy_item(obj->items + i);
 	}
+	MF_MEM_ACCT(MF_MEM_JSON, -(long)(obj->max_items * sizeof *obj->items));
 	free(obj->items);
 }
 
@@ -59,6 +63,7 @@ struct json_arr *json_alloc_arr(void)
 		fprintf(stderr, "json_alloc_arr: failed to allocate array\n");
 		return 0;
 	}
+	MF_MEM_ACCT(MF_MEM_JSON, sizeof *arr);
 	json_init_arr(arr);
 	return arr;
 }
@@ -66,6 +71,7 @@ struct json_arr *json_alloc_arr(void)
 void json_free_arr(struct json_arr *arr)
 {
 	json_destroy_arr(arr);
+	MF_MEM_ACCT(MF_MEM_JSON, -(long)sizeof *arr);
 	free(arr);
 }
 
@@ -81,6 +87,7 @@ void json_destroy_arr(struct json_arr *arr)
 	for(i=0; i<arr->size; i++) {
 		json_destroy_value(arr->val + i);
 	}
+	MF_MEM_ACCT(MF_MEM_JSON, -(long)(arr->maxsize * sizeof *arr->val));
 	free(arr->val);
 }
 
@@ -93,11 +100,15 @@ int json_item(struct json_item *item, const char *name)
 		fprintf(stderr, "json_item: failed to allocate name\n");
 		return -1;
 	}
+	MF_MEM_ACCT(MF_MEM_JSON, strlen(name) + 1);
 	return 0;
 }
 
 void json_destroy_item(struct json_item *item)
 {
+	if(item->name) {
+		MF_MEM_ACCT(MF_MEM_JSON, -(long)(strlen(item->name) + 1));
+	}
 	free(item->name);
 	json_destroy_value(&item->val);
 }
@@ -107,10 +118,13 @@ int json_value_str(struct json_value *jv, const char *str)
 	jv->type = JSON_STR;
 
 	jv->str = 0;
-	if(str && !(jv->str = strdup(str))) {
+	if(str && (MF_MEM_CHECK(strlen(str) + 1) == -1 || !(jv->str = strdup(str)))) {
 		fprintf(stderr, "json_value_str: failed to duplicate string\n");
 		return -1;
 	}
+	if(str) {
+		MF_MEM_ACCT(MF_MEM_JSON, strlen(str) + 1);
+	}
 	return 0;
 }
 
@@ -158,6 +172,9 @@ void json_destroy_value(struct json_value *jv)
 {
 	switch(jv->type) {
 	case JSON_STR:
+		if(jv->str) {
+			MF_MEM_ACCT(MF_MEM_JSON, -(long)(strlen(jv->str) + 1));
+		}
 		free(jv->str);
 		break;
 
@@ -178,11 +195,13 @@ int json_obj_append(struct json_obj *obj, const struct json_item *item)
 {
 	if(obj->num_items >= obj->max_items) {
 		int newsz = obj->max_items ? (obj->max_items << 1) : 8;
-		void *tmp = realloc(obj->items, newsz * sizeof *obj->items);
-		if(!tmp) {
+		void *tmp = 0;
+		if(MF_MEM_CHECK((newsz - obj->max_items) * sizeof *obj->items) == -1 ||
+				!(tmp = realloc(obj->items, newsz * sizeof *obj->items))) {
 			fprintf(stderr, "json_obj_append: failed to grow items array (%d)\n", newsz);
 			return -1;
 		}
+		MF_MEM_ACCT(MF_MEM_JSON, (long)((newsz - obj->max_items) * sizeof *obj->items));
 		obj->items = tmp;
 		obj->max_items = newsz;
 	}
@@ -195,11 +214,13 @@ int json_arr_append(struct json_arr *arr, const struct json_value *val)
 {
 	if(arr->size >= arr->maxsize) {
 		int newsz = arr->maxsize ? (arr->maxsize << 1) : 8;
-		void *tmp = realloc(arr->val, newsz * sizeof *arr->val);
-		if(!tmp) {
+		void *tmp = 0;
+		if(MF_MEM_CHECK((newsz - arr->maxsize) * sizeof *arr->val) == -1 ||
+				!(tmp = realloc(arr->val, newsz * sizeof *arr->val))) {
 			fprintf(stderr, "json_arr_append: failed to grow array (%d)\n", newsz);
 			return -1;
 		}
+		MF_MEM_ACCT(MF_MEM_JSON, (long)((newsz - arr->maxsize) * sizeof *arr->val));
 		arr->val = tmp;
 		arr->maxsize = newsz;
 	}
@@ -346,11 +367,33 @@ static int next_char(struct parser *p)
 
 #define SET_TOKEN(token, str, len) \
 	do { \
-		DYNARR_RESIZE(token, (len) + 1); \
+		char *tmp; \
+		if(!(tmp = mf_dynarr_resize((token), (len) + 1))) { \
+			return -1; \
+		} \
+		(token) = tmp; \
 		memcpy(token, str, len); \
 		token[len] = 0; \
 	} while(0)
 
+/* append a character to the current token, keeping it zero-terminated */
+static int token_putc(struct parser *p, char c)
+{
+	char *tmp;
+	char buf[2];
+
+	buf[0] = c;
+	buf[1] = 0;
+	if(!mf_dynarr_empty(p->token)) {
+		p->token = mf_dynarr_pop(p->token);
+	}
+	if(!(tmp = mf_dynarr_pushn(p->token, buf, 2))) {
+		return -1;
+	}
+	p->token = tmp;
+	return 0;
+}
+
 static int next_token(struct parser *p)
 {
 	int len;
@@ -373,7 +416,10 @@ static int next_token(struct parser *p)
 		DYNARR_CLEAR(p->token);
 		next_char(p);
 		while(p->nextc && p->nextc != '"') {
-			DYNARR_STRPUSH(p->token, p->nextc);
+			if(token_putc(p, p->nextc) == -1) {
+				fprintf(stderr, "json_parse: failed to grow string token\n");
+				return -1;
+			}
 			next_char(p);
 		}
 		next_char(p);
@@ -491,6 +537,7 @@ static int item(struct parser *p, struct json_item *it)
 	}
 	EXPECT(p, ':');
 	if(value(p, &it->val) == -1) {
+		MF_MEM_ACCT(MF_MEM_JSON, -(long)(strlen(it->name) + 1));
 		free(it->name);
 		return -1;
 	}
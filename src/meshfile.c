@@ -23,10 +23,14 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <ctype.h>
 #include <errno.h>
 #include <assert.h>
+#include <sys/stat.h>
 #include "meshfile.h"
 #include "mfpriv.h"
 #include "dynarr.h"
 #include "util.h"
+#include "bufio.h"
+#include "gzip.h"
+#include "trace.h"
 
 /* the order in this table is significant. It's the order used when trying to
  * open a file. wavefront obj must be last, because it can't be identified.
@@ -41,9 +45,16 @@ struct filefmt filefmt[MF_NUM_FMT] = {
 };
 
 static void assetpath_rbdelnode(struct rbnode *n, void *cls);
+static char *probe_asset(const char *dir, const char *fname);
+static int resolve_asset(struct mf_meshfile *mf, char **nameptr);
+static void add_name(struct mf_meshfile *mf, int type, const char *name, void *obj);
 
 static void init_aabox(mf_aabox *box);
-static void calc_aabox(struct mf_meshfile *mf);
+static void update_node_xform(struct mf_node *n);
+static void update_bounds(struct mf_meshfile *mf);
+static void calc_mesh_aabox(struct mf_mesh *m);
+static void calc_node_aabox(struct mf_node *n);
+static void union_aabox(mf_aabox *box, const mf_aabox *b);
 static void expand_aabox(mf_aabox *box, mf_vec3 v);
 
 static void *io_open(const char *fname, const char *mode);
@@ -52,6 +63,17 @@ static int io_read(void *file, void *buf, int sz);
 static int io_write(void *file, const void *buf, int sz);
 static long io_seek(void *file, long offs, int from);
 
+static int load(struct mf_meshfile *mf, const struct mf_userio *io, unsigned int flags);
+static void count_elements(struct mf_meshfile *mf, struct mf_load_stats *st);
+static int load_progress(long pos, void *cls);
+static int save_progress(long pos, void *cls);
+
+static unsigned long mtl_memsize(const struct mf_material *mtl, unsigned long *names);
+
+#ifdef MF_TLS
+MF_TLS struct mf_meshfile *mf_cur_load;
+#endif
+
 #define MF_FMT_MASK		0xff
 
 #define DEFMAP \
@@ -117,6 +139,13 @@ int mf_init(struct mf_meshfile *mf)
 		goto err;
 	}
 	rb_set_delete_func(mf->assetpath, assetpath_rbdelnode, 0);
+	if(!(mf->searchpath = mf_dynarr_alloc(0, sizeof *mf->searchpath))) {
+		goto err;
+	}
+
+	if(!(mf->names = mf_nameidx_create())) {
+		goto err;
+	}
 
 	init_aabox(&mf->aabox);
 	return 0;
@@ -126,6 +155,9 @@ err:
 	mf_dynarr_free(mf->mtl); mf->mtl = 0;
 	mf_dynarr_free(mf->nodes); mf->nodes = 0;
 	mf_dynarr_free(mf->topnodes); mf->topnodes = 0;
+	mf_dynarr_free(mf->searchpath); mf->searchpath = 0;
+	if(mf->assetpath) rb_free(mf->assetpath);
+	mf->assetpath = 0;
 	return -1;
 }
 
@@ -138,7 +170,10 @@ void mf_destroy(struct mf_meshfile *mf)
 	mf_dynarr_free(mf->topnodes);
 	free(mf->name);
 	free(mf->dirname);
+	mf_clear_asset_paths(mf);
+	mf_dynarr_free(mf->searchpath);
 	rb_free(mf->assetpath);
+	mf_nameidx_free(mf->names);
 }
 
 void mf_clear(struct mf_meshfile *mf)
@@ -162,6 +197,127 @@ void mf_clear(struct mf_meshfile *mf)
 	mf->topnodes = mf_dynarr_clear(mf->topnodes);
 
 	rb_clear(mf->assetpath);
+	mf_nameidx_clear(mf->names);
+}
+
+struct mf_meshfile *mf_clone_meshfile(const struct mf_meshfile *mf)
+{
+	int i, j, num, added = 0;
+	struct mf_meshfile *clone;
+	struct mf_material *mtl;
+	struct mf_mesh *mesh;
+	struct mf_node *orig, **nodes = 0;
+	struct rbtree *map;		/* original objects -> copies */
+	struct rbnode *rbn;
+
+	if(!(clone = mf_alloc())) {
+		return 0;
+	}
+	if(!(map = rb_create(RB_KEY_ADDR))) {
+		mf_free(clone);
+		return 0;
+	}
+
+	if((mf->name && !(clone->name = strdup(mf->name))) ||
+			(mf->dirname && !(clone->dirname = strdup(mf->dirname)))) {
+		goto err;
+	}
+	clone->flags = mf->flags;
+	num = mf_dynarr_size(mf->searchpath);
+	for(i=0; i<num; i++) {
+		if(mf_add_asset_path(clone, mf->searchpath[i]) == -1) {
+			goto err;
+		}
+	}
+
+	num = mf_dynarr_size(mf->mtl);
+	for(i=0; i<num; i++) {
+		if(!(mtl = malloc(sizeof *mtl))) {
+			goto err;
+		}
+		if(mf_copy_mtl(mtl, mf->mtl[i]) == -1) {
+			free(mtl);
+			goto err;
+		}
+		if(mf_add_material(clone, mtl) == -1) {
+			mf_free_mtl(mtl);
+			goto err;
+		}
+		rb_insert(map, mf->mtl[i], mtl);
+	}
+
+	num = mf_dynarr_size(mf->meshes);
+	for(i=0; i<num; i++) {
+		if(!(mesh = mf_clone_mesh(mf->meshes[i]))) {
+			goto err;
+		}
+		if((rbn = rb_find(map, mesh->mtl))) {
+			mesh->mtl = rbn->data;
+		}
+		if(mf_add_mesh(clone, mesh) == -1) {
+			mf_free_mesh(mesh);
+			goto err;
+		}
+		rb_insert(map, mf->meshes[i], mesh);
+	}
+
+	/* copy all nodes first, so that we can link them up regardless of order */
+	num = mf_dynarr_size(mf->nodes);
+	if(!(nodes = calloc(num ? num : 1, sizeof *nodes))) {
+		goto err;
+	}
+	for(i=0; i<num; i++) {
+		orig = mf->nodes[i];
+		if(!(nodes[i] = mf_alloc_node())) {
+			goto err;
+		}
+		if(orig->name && !(nodes[i]->name = strdup(orig->name))) {
+			goto err;
+		}
+		memcpy(nodes[i]->matrix, orig->matrix, sizeof orig->matrix);
+		memcpy(nodes[i]->global_matrix, orig->global_matrix, sizeof orig->global_matrix);
+		nodes[i]->udata = orig->udata;
+		rb_insert(map, orig, nodes[i]);
+	}
+	for(i=0; i<num; i++) {
+		orig = mf->nodes[i];
+		for(j=0; j<orig->num_meshes; j++) {
+			rbn = rb_find(map, orig->meshes[j]);
+			if(mf_node_add_mesh(nodes[i], rbn ? rbn->data : orig->meshes[j]) == -1) {
+				goto err;
+			}
+		}
+		for(j=0; j<orig->num_child; j++) {
+			if(!(rbn = rb_find(map, orig->child[j]))) {
+				continue;	/* child not in the meshfile */
+			}
+			if(mf_node_add_child(nodes[i], rbn->data) == -1) {
+				goto err;
+			}
+		}
+	}
+	for(i=0; i<num; i++) {
+		if(mf_add_node(clone, nodes[i]) == -1) {
+			goto err;
+		}
+		added++;
+	}
+
+	clone->aabox = mf->aabox;
+	free(nodes);
+	rb_free(map);
+	return clone;
+
+err:
+	if(nodes) {
+		for(i=added; i<num; i++) {
+			mf_free_node(nodes[i]);
+		}
+		free(nodes);
+	}
+	rb_free(map);
+	mf_free(clone);
+	return 0;
 }
 
 struct mf_mesh *mf_alloc_mesh(void)
@@ -195,6 +351,7 @@ int mf_init_mesh(struct mf_mesh *m)
 void mf_destroy_mesh(struct mf_mesh *m)
 {
 	free(m->name);
+	free(m->immed);
 	mf_dynarr_free(m->vertex);
 	mf_dynarr_free(m->normal);
 	mf_dynarr_free(m->tangent);
@@ -229,6 +386,42 @@ int mf_init_mtl(struct mf_material *mtl)
 	return 0;
 }
 
+/* deep copy, used by the material library cache */
+int mf_copy_mtl(struct mf_material *dest, const struct mf_material *src)
+{
+	int i, j;
+	struct mf_texmap *map;
+
+	memcpy(dest, src, sizeof *dest);
+	for(i=0; i<MF_NUM_MTLATTR; i++) {
+		map = &dest->attr[i].map;
+		map->name = 0;
+		memset(map->cube, 0, sizeof map->cube);
+	}
+	if(src->name != defmtl.name && !(dest->name = strdup(src->name))) {
+		dest->name = defmtl.name;
+		return -1;
+	}
+
+	for(i=0; i<MF_NUM_MTLATTR; i++) {
+		map = &dest->attr[i].map;
+		if(src->attr[i].map.name && !(map->name = strdup(src->attr[i].map.name))) {
+			goto err;
+		}
+		for(j=0; j<6; j++) {
+			if(src->attr[i].map.cube[j] && !(map->cube[j] = strdup(src->attr[i].map.cube[j]))) {
+				goto err;
+			}
+		}
+	}
+	return 0;
+
+err:
+	mf_destroy_mtl(dest);
+	mf_init_mtl(dest);
+	return -1;
+}
+
 void mf_destroy_mtl(struct mf_material *mtl)
 {
 	int i, j;
@@ -277,6 +470,8 @@ int mf_init_node(struct mf_node *node)
 
 	mf_id_matrix(node->matrix);
 	mf_id_matrix(node->global_matrix);
+	init_aabox(&node->aabox);
+	node->dirty = MF_DIRTY_XFORM | MF_DIRTY_BOUNDS;
 	return 0;
 }
 
@@ -333,9 +528,23 @@ struct mf_node *mf_get_topnode(const struct mf_meshfile *mf, int idx)
 	return mf->topnodes[idx];
 }
 
+/* the name index maps each name to the first object of each type added with
+ * that name. If the object has been renamed since, search the hard way.
+ */
 struct mf_mesh *mf_find_mesh(const struct mf_meshfile *mf, const char *name)
 {
-	int i, num = mf_dynarr_size(mf->meshes);
+	int i, num;
+	struct mf_mesh *obj;
+	struct mf_nameent *ent;
+
+	if(!(ent = mf_nameidx_find(mf->names, name)) || !(obj = ent->obj[MF_NAME_MESH])) {
+		return 0;
+	}
+	if(strcmp(obj->name, name) == 0) {
+		return obj;
+	}
+
+	num = mf_dynarr_size(mf->meshes);
 	for(i=0; i<num; i++) {
 		if(strcmp(mf->meshes[i]->name, name) == 0) {
 			return mf->meshes[i];
@@ -346,7 +555,18 @@ struct mf_mesh *mf_find_mesh(const struct mf_meshfile *mf, const char *name)
 
 struct mf_material *mf_find_material(const struct mf_meshfile *mf, const char *name)
 {
-	int i, num = mf_dynarr_size(mf->mtl);
+	int i, num;
+	struct mf_material *obj;
+	struct mf_nameent *ent;
+
+	if(!(ent = mf_nameidx_find(mf->names, name)) || !(obj = ent->obj[MF_NAME_MTL])) {
+		return 0;
+	}
+	if(strcmp(obj->name, name) == 0) {
+		return obj;
+	}
+
+	num = mf_dynarr_size(mf->mtl);
 	for(i=0; i<num; i++) {
 		if(strcmp(mf->mtl[i]->name, name) == 0) {
 			return mf->mtl[i];
@@ -357,7 +577,18 @@ struct mf_material *mf_find_material(const struct mf_meshfile *mf, const char *n
 
 struct mf_node *mf_find_node(const struct mf_meshfile *mf, const char *name)
 {
-	int i, num = mf_dynarr_size(mf->nodes);
+	int i, num;
+	struct mf_node *obj;
+	struct mf_nameent *ent;
+
+	if(!(ent = mf_nameidx_find(mf->names, name)) || !(obj = ent->obj[MF_NAME_NODE])) {
+		return 0;
+	}
+	if(strcmp(obj->name, name) == 0) {
+		return obj;
+	}
+
+	num = mf_dynarr_size(mf->nodes);
 	for(i=0; i<num; i++) {
 		if(strcmp(mf->nodes[i]->name, name) == 0) {
 			return mf->nodes[i];
@@ -376,6 +607,7 @@ int mf_add_mesh(struct mf_meshfile *mf, struct mf_mesh *m)
 		return -1;
 	}
 	mf->meshes = tmp;
+	add_name(mf, MF_NAME_MESH, m->name, m);
 	return 0;
 }
 
@@ -389,6 +621,7 @@ int mf_add_material(struct mf_meshfile *mf, struct mf_material *mtl)
 		return -1;
 	}
 	mf->mtl = tmp;
+	add_name(mf, MF_NAME_MTL, mtl->name, mtl);
 	return 0;
 }
 
@@ -410,11 +643,14 @@ int mf_add_node(struct mf_meshfile *mf, struct mf_node *n)
 		}
 		mf->topnodes = tmp;
 	}
+	add_name(mf, MF_NAME_NODE, n->name, n);
 	return 0;
 }
 
 int mf_bounds(const struct mf_meshfile *mf, mf_aabox *bb)
 {
+	update_bounds((struct mf_meshfile*)mf);
+
 	if(mf->aabox.vmax.x < mf->aabox.vmin.x) {
 		return -1;
 	}
@@ -425,26 +661,64 @@ int mf_bounds(const struct mf_meshfile *mf, mf_aabox *bb)
 void mf_update_xform(struct mf_meshfile *mf)
 {
 	int i, num = mf_num_topnodes(mf);
+	double tspan;
+
+	TRACE_BEGIN(tspan);
 	for(i=0; i<num; i++) {
 		mf_node_update_xform(mf->topnodes[i]);
 	}
+	TRACE_END(tspan, "update_xform");
 }
 
 int mf_apply_xform(struct mf_meshfile *mf)
 {
 	unsigned int i, j, num_nodes;
 	struct mf_node *node;
+	struct mf_mesh *mesh;
+	struct rbtree *seen;
+	double tspan;
 
+	TRACE_BEGIN(tspan);
+	if(!(seen = rb_create(RB_KEY_ADDR))) {
+		return -1;
+	}
+
+	/* meshes shared by multiple nodes need a separate copy for each node. The
+	 * copies share their data until the transformation is applied.
+	 */
 	num_nodes = mf_num_nodes(mf);
 	for(i=0; i<num_nodes; i++) {
 		node = mf_get_node(mf, i);
 		for(j=0; j<node->num_meshes; j++) {
-			/* TODO clone meshes referenced by more than one nodes */
+			mesh = node->meshes[j];
+			if(!rb_find(seen, mesh)) {
+				rb_insert(seen, mesh, 0);
+				continue;
+			}
+			if(!(mesh = mf_clone_mesh(mesh))) {
+				rb_free(seen);
+				return -1;
+			}
+			if(mf_add_mesh(mf, mesh) == -1) {
+				mf_free_mesh(mesh);
+				rb_free(seen);
+				return -1;
+			}
+			node->meshes[j] = mesh;
+		}
+	}
+	rb_free(seen);
+
+	for(i=0; i<num_nodes; i++) {
+		node = mf_get_node(mf, i);
+		for(j=0; j<node->num_meshes; j++) {
 			mf_transform_mesh(node->meshes[j], node->global_matrix);
 		}
 		mf_id_matrix(node->matrix);
 		mf_id_matrix(node->global_matrix);
+		node->dirty |= MF_DIRTY_BOUNDS;
 	}
+	TRACE_END(tspan, "apply_xform");
 	return 0;
 }
 
@@ -470,24 +744,332 @@ int mf_load(struct mf_meshfile *mf, const char *fname, unsigned int flags)
 		slash = mf->dirname + (slash - fname);
 		*slash = 0;
 	}
+	rb_clear(mf->assetpath);	/* cached lookups are relative to dirname */
 
 	res = mf_load_userio(mf, &io, flags);
 	fclose(fp);
 	return res;
 }
 
+/* used by mf_load_batch, for files which have already been read into memory */
+int mf_load_buffer(struct mf_meshfile *mf, const char *fname, void *buf, long size,
+		unsigned int flags)
+{
+	int res;
+	char *slash;
+	struct mf_userio io = {0}, bio;
+
+	io.open = io_open;
+	io.close = io_close;
+	io.read = io_read;
+	io.seek = io_seek;
+
+	if(mf_bufio_memopen(&bio, &io, buf, size) == -1) {
+		fprintf(stderr, "mf_load_buffer: failed to allocate reader\n");
+		return -1;
+	}
+
+	mf->name = strdup(fname);
+	if((slash = strrchr(fname, '/')) && (mf->dirname = strdup(fname))) {
+		slash = mf->dirname + (slash - fname);
+		*slash = 0;
+	}
+	rb_clear(mf->assetpath);	/* cached lookups are relative to dirname */
+
+	res = mf_load_userio(mf, &bio, flags);
+	mf_bufio_rdclose(&bio);
+
+	if(flags & MF_STATS) {
+		mf->stats.bytes_read = size;
+	}
+	return res;
+}
+
 int mf_load_userio(struct mf_meshfile *mf, const struct mf_userio *io, unsigned int flags)
+{
+	int res = -1;
+	double t0 = 0, tspan;
+	struct mf_userio bio, gzio, gzbio;
+	const struct mf_userio *rdio = io;
+	struct mf_load_stats *st = 0;
+
+	TRACE_BEGIN(tspan);
+
+	if(flags & MF_STATS) {
+		st = &mf->stats;
+		memset(st, 0, sizeof *st);
+		t0 = mf_get_time();
+	}
+	mf->stats_valid = st != 0;
+	memset(&mf->memacct, 0, sizeof mf->memacct);
+#ifdef MF_TLS
+	mf_cur_load = st || mf->memlimit ? mf : 0;
+#endif
+
+	/* loaders go through a buffered reader, which reads ahead in a background
+	 * thread, overlapping I/O with parsing.
+	 */
+	if(!mf_is_bufio(io) && mf_bufio_rdopen(&bio, io, 1) != -1) {
+		rdio = &bio;
+		if(st) mf_bufio_stats(&bio, st);
+	}
+
+	mf->progress_stop = 0;
+	mf->progress_total = -1;
+	if(mf->progress && mf_is_bufio(rdio)) {
+		long pos = rdio->seek(rdio->file, 0, MF_SEEK_CUR);
+		mf->progress_total = rdio->seek(rdio->file, 0, MF_SEEK_END);
+		rdio->seek(rdio->file, pos, MF_SEEK_SET);
+		mf_bufio_progress(rdio, load_progress, mf);
+	}
+
+	if(mf_gzip_check(rdio)) {
+		/* gzip compressed file, decompress on the fly, buffering the output to
+		 * keep the loaders' seeks from restarting decompression.
+		 */
+		if(mf_gzip_rdopen(&gzio, rdio) != -1) {
+			if(mf_bufio_rdopen(&gzbio, &gzio, 0) != -1) {
+				res = load(mf, &gzbio, flags);
+				mf_bufio_rdclose(&gzbio);
+			}
+			mf_gzip_rdclose(&gzio);
+		}
+	} else {
+		res = load(mf, rdio, flags);
+	}
+
+	if(rdio == &bio) {
+		mf_bufio_rdclose(&bio);
+	} else if(mf->progress && mf_is_bufio(rdio)) {
+		mf_bufio_progress(rdio, 0, 0);
+	}
+
+	if(st) {
+		if(res != -1) {
+			count_elements(mf, st);
+		}
+		st->mem_peak = mf->memacct.peak_total;
+		st->total = mf_get_time() - t0;
+	}
+#ifdef MF_TLS
+	mf_cur_load = 0;
+#endif
+	TRACE_END_ARG(tspan, "load", mf->name);
+	return res;
+}
+
+int mf_load_stats(const struct mf_meshfile *mf, struct mf_load_stats *st)
+{
+	if(!mf->stats_valid) {
+		return -1;
+	}
+	*st = mf->stats;
+	return 0;
+}
+
+int mf_set_mem_limit(struct mf_meshfile *mf, unsigned long bytes)
+{
+#ifdef MF_TLS
+	mf->memlimit = bytes;
+	return 0;
+#else
+	fprintf(stderr, "mf_set_mem_limit: memory budgets not supported by this build\n");
+	return -1;
+#endif
+}
+
+unsigned long mf_get_mem_limit(const struct mf_meshfile *mf)
+{
+	return mf->memlimit;
+}
+
+void mf_set_progress(struct mf_meshfile *mf, mf_progress_func func, void *cls)
+{
+	mf->progress = func;
+	mf->progress_cls = cls;
+}
+
+void mf_set_writev(struct mf_meshfile *mf, mf_writev_func func)
+{
+	mf->writev = func;
+}
+
+int mf_report_progress(const struct mf_meshfile *mf, int stage, long done, long total)
+{
+	if(mf->progress(stage, done, total, mf->progress_cls)) {
+		((struct mf_meshfile*)mf)->progress_stop = 1;
+		return -1;
+	}
+	return 0;
+}
+
+static int load_progress(long pos, void *cls)
+{
+	struct mf_meshfile *mf = cls;
+	return mf_report_progress(mf, MF_STAGE_READ, pos, mf->progress_total);
+}
+
+static int save_progress(long pos, void *cls)
+{
+	return mf_report_progress(cls, MF_STAGE_WRITE, pos, -1);
+}
+
+int mf_mem_stats(const struct mf_meshfile *mf, struct mf_mem_stats *ms)
+{
+	int i, j, num;
+	unsigned long *used = ms->used;
+	struct mf_mesh *m;
+	struct mf_node *n;
+	char **path;
+
+	memset(ms, 0, sizeof *ms);
+
+	num = mf_num_meshes(mf);
+	for(i=0; i<num; i++) {
+		m = mf->meshes[i];
+		used[MF_MEM_OTHER] += sizeof *m;
+		used[MF_MEM_NAMES] += m->name ? strlen(m->name) + 1 : 0;
+		used[MF_MEM_ATTR] += mf_dynarr_memsize(m->vertex) + mf_dynarr_memsize(m->normal) +
+			mf_dynarr_memsize(m->tangent) + mf_dynarr_memsize(m->texcoord) +
+			mf_dynarr_memsize(m->color);
+		used[MF_MEM_FACES] += mf_dynarr_memsize(m->faces);
+	}
+
+	num = mf_num_nodes(mf);
+	for(i=0; i<num; i++) {
+		n = mf->nodes[i];
+		used[MF_MEM_OTHER] += sizeof *n + mf_dynarr_memsize(n->child) +
+			mf_dynarr_memsize(n->meshes);
+		used[MF_MEM_NAMES] += n->name ? strlen(n->name) + 1 : 0;
+	}
+
+	num = mf_num_materials(mf);
+	for(i=0; i<num; i++) {
+		used[MF_MEM_OTHER] += mtl_memsize(mf->mtl[i], used + MF_MEM_NAMES);
+	}
+
+	used[MF_MEM_OTHER] += sizeof *mf + mf_dynarr_memsize(mf->meshes) +
+		mf_dynarr_memsize(mf->mtl) + mf_dynarr_memsize(mf->nodes) +
+		mf_dynarr_memsize(mf->topnodes) + mf_dynarr_memsize(mf->searchpath);
+
+	used[MF_MEM_NAMES] += mf->name ? strlen(mf->name) + 1 : 0;
+	used[MF_MEM_NAMES] += mf->dirname ? strlen(mf->dirname) + 1 : 0;
+	if((path = mf->searchpath)) {
+		num = mf_dynarr_size(path);
+		for(j=0; j<num; j++) {
+			used[MF_MEM_NAMES] += strlen(path[j]) + 1;
+		}
+	}
+	if(mf->names) {
+		used[MF_MEM_NAMES] += mf_nameidx_memsize(mf->names);
+	}
+	if(mf->assetpath) {
+		used[MF_MEM_RBTREE] += rb_size(mf->assetpath) * sizeof(struct rbnode);
+	}
+
+	for(i=0; i<MF_NUM_MEMCAT; i++) {
+		ms->used_total += ms->used[i];
+		ms->peak[i] = mf->memacct.peak[i];
+	}
+	ms->peak_total = mf->memacct.peak_total;
+	return 0;
+}
+
+static unsigned long mtl_memsize(const struct mf_material *mtl, unsigned long *names)
+{
+	int i, j;
+	const struct mf_texmap *map;
+
+	*names += mtl->name ? strlen(mtl->name) + 1 : 0;
+	for(i=0; i<MF_NUM_MTLATTR; i++) {
+		map = &mtl->attr[i].map;
+		*names += map->name ? strlen(map->name) + 1 : 0;
+		for(j=0; j<6; j++) {
+			*names += map->cube[j] ? strlen(map->cube[j]) + 1 : 0;
+		}
+	}
+	return sizeof *mtl;
+}
+
+#ifdef MF_TLS
+void mf_mem_acct(int cat, long delta)
+{
+	struct mf_memacct *ma = &mf_cur_load->memacct;
+
+	if((ma->cur[cat] += delta) < 0) {
+		/* freeing something allocated before the load started */
+		delta -= ma->cur[cat];
+		ma->cur[cat] = 0;
+	}
+	if(ma->cur[cat] > ma->peak[cat]) {
+		ma->peak[cat] = ma->cur[cat];
+	}
+	ma->total += delta;
+	if(ma->total > ma->peak_total) {
+		ma->peak_total = ma->total;
+	}
+}
+
+int mf_mem_check(unsigned long size)
+{
+	struct mf_meshfile *mf = mf_cur_load;
+	unsigned long cur = mf->memacct.total;
+
+	if(cur <= mf->memlimit && size <= mf->memlimit - cur) {
+		return 0;
+	}
+	if(!mf->memacct.over) {
+		fprintf(stderr, "mf_load: memory budget of %lu bytes exceeded\n", mf->memlimit);
+		mf->memacct.over = 1;
+	}
+	return -1;
+}
+#endif
+
+static void count_elements(struct mf_meshfile *mf, struct mf_load_stats *st)
+{
+	unsigned int i;
+	struct mf_mesh *mesh;
+
+	st->num_meshes = mf_num_meshes(mf);
+	st->num_materials = mf_num_materials(mf);
+	st->num_nodes = mf_num_nodes(mf);
+
+	for(i=0; i<st->num_meshes; i++) {
+		mesh = mf_get_mesh(mf, i);
+		st->num_verts += mesh->num_verts;
+		st->num_faces += mesh->num_faces;
+	}
+}
+
+static int load(struct mf_meshfile *mf, const struct mf_userio *io, unsigned int flags)
 {
 	unsigned int i, num_meshes;
 	struct mf_mesh *mesh;
 	long fpos = io->seek(io->file, 0, MF_SEEK_CUR);
+	double t0 = 0, tspan;
+	struct mf_load_stats *st = flags & MF_STATS ? &mf->stats : 0;
 
 	mf->flags = flags;
 
 	for(i=0; i<MF_NUM_FMT; i++) {
+		if(st) t0 = mf_get_time();
+		TRACE_BEGIN(tspan);
 		if(filefmt[i].load && filefmt[i].load(mf, io) == 0) {
+			TRACE_END_ARG(tspan, "parse", filefmt[i].suffixes[0]);
+			if(st) {
+				st->parse = mf_get_time() - t0 - st->dedup;
+				st->fmt = filefmt[i].fmt;
+			}
 			break;
 		}
+		TRACE_END_ARG(tspan, "probe", filefmt[i].suffixes[0]);
+		if(st) st->probe += mf_get_time() - t0;
+
+		/* don't fall through to the other loaders if it failed for lack of memory */
+		if(MF_CANCELLED(mf) || mf->memacct.over) {
+			goto fail;
+		}
 		if(io->seek(io->file, fpos, MF_SEEK_SET) == -1) {
 			return -1;
 		}
@@ -496,36 +1078,76 @@ int mf_load_userio(struct mf_meshfile *mf, const struct mf_userio *io, unsigned
 	if(i == MF_NUM_FMT) {
 		return -1;
 	}
+	/* loaders may stop early and succeed when reads start failing */
+	if(MF_CANCELLED(mf)) {
+		goto fail;
+	}
+	if(mf->progress_total > 0 && MF_PROGRESS(mf, MF_STAGE_READ, mf->progress_total,
+				mf->progress_total) == -1) {
+		goto fail;
+	}
+	if(st) t0 = mf_get_time();
 	mf_update_xform(mf);
-	calc_aabox(mf);
+	if(st) {
+		st->xform = mf_get_time() - t0;
+		t0 = mf_get_time();
+	}
+	update_bounds(mf);
+	if(st) st->bounds = mf_get_time() - t0;
 
 	/* do any post-processing after load */
 	if(flags & MF_NOPROC) return 0;
 
+	if(st) t0 = mf_get_time();
 	num_meshes = mf_num_meshes(mf);
 	for(i=0; i<num_meshes; i++) {
+		if(MF_PROGRESS(mf, MF_STAGE_NORMALS, i, num_meshes) == -1 || MF_CANCELLED(mf)) {
+			goto fail;
+		}
 		mesh = mf_get_mesh(mf, i);
 		if(!mesh->normal) {
 			if(mf_calc_normals(mesh) == -1) {
-				return -1;
+				goto fail;
 			}
 		}
 	}
+	if(st) st->normals = mf_get_time() - t0;
 
 	if(flags & MF_GEN_TANGENTS) {
+		if(st) t0 = mf_get_time();
 		for(i=0; i<num_meshes; i++) {
+			if(MF_PROGRESS(mf, MF_STAGE_TANGENTS, i, num_meshes) == -1 || MF_CANCELLED(mf)) {
+				goto fail;
+			}
 			mesh = mf_get_mesh(mf, i);
 			mf_calc_tangents(mesh);
 		}
+		if(mf->memacct.over) {
+			goto fail;
+		}
+		if(st) st->tangents = mf_get_time() - t0;
 	}
 
 	if(flags & MF_APPLY_XFORM) {
+		if(st) t0 = mf_get_time();
+		if(MF_PROGRESS(mf, MF_STAGE_XFORM, 0, num_meshes) == -1) {
+			goto fail;
+		}
 		if(mf_apply_xform(mf) == -1) {
 			mf_clear(mf);
 			return -1;
 		}
+		if(MF_PROGRESS(mf, MF_STAGE_XFORM, num_meshes, num_meshes) == -1) {
+			goto fail;
+		}
+		if(st) st->xform += mf_get_time() - t0;
 	}
 	return 0;
+
+fail:
+	/* don't leave a partially loaded scene behind */
+	mf_clear(mf);
+	return -1;
 }
 
 int mf_strcasecmp(const char *a, const char *b)
@@ -544,7 +1166,8 @@ int mf_save(const struct mf_meshfile *mf, const char *fname, unsigned int flags)
 	struct mf_meshfile *mmf;
 	struct mf_userio io = {0};
 	char *orig_name, *orig_dirname, *slash;
-	const char *suffix;
+	const char *suffix, *sfxend;
+	char sfxbuf[16];
 
 	if(!(fp = fopen(fname, "wb"))) {
 		fprintf(stderr, "mf_save: failed to open %s for writing: %s\n", fname, strerror(errno));
@@ -567,7 +1190,21 @@ int mf_save(const struct mf_meshfile *mf, const char *fname, unsigned int flags)
 		*slash = 0;
 	}
 
-	if((flags & MF_FMT_MASK) == 0 && (suffix = strrchr(fname, '.'))) {
+	if((suffix = strrchr(fname, '.')) && mf_strcasecmp(suffix + 1, "gz") == 0) {
+		/* compressed output, the format is determined by the previous suffix */
+		flags |= MF_GZIP;
+		sfxend = suffix;
+		while(suffix > fname && *--suffix != '.' && *suffix != '/');
+		if(*suffix != '.' || sfxend - suffix >= (int)sizeof sfxbuf) {
+			suffix = 0;
+		} else {
+			memcpy(sfxbuf, suffix, sfxend - suffix);
+			sfxbuf[sfxend - suffix] = 0;
+			suffix = sfxbuf;
+		}
+	}
+
+	if((flags & MF_FMT_MASK) == 0 && suffix) {
 		for(i=0; i<MF_NUM_FMT; i++) {
 			for(j=0; filefmt[i].suffixes[j]; j++) {
 				if(mf_strcasecmp(suffix + 1, filefmt[i].suffixes[j]) == 0) {
@@ -591,17 +1228,50 @@ matched:
 
 int mf_save_userio(const struct mf_meshfile *mf, const struct mf_userio *io, unsigned int flags)
 {
-	int i, fmt;
+	int i, fmt, res;
+	struct mf_userio bio;
+	double tspan;
 
 	if(!(fmt = flags & MF_FMT_MASK)) {
 		fmt = MF_FMT_OBJ;
 	}
 
 	((struct mf_meshfile*)mf)->flags = flags;
+	((struct mf_meshfile*)mf)->progress_stop = 0;
 
 	for(i=0; i<MF_NUM_FMT; i++) {
 		if(filefmt[i].fmt == fmt) {
-			return filefmt[i].save(mf, io);
+			if(flags & MF_GZIP) {
+				/* the compressor buffers everything, and compresses on close */
+				if(mf_gzip_wropen(&bio, io) == -1) {
+					return -1;
+				}
+				TRACE_BEGIN(tspan);
+				res = filefmt[i].save(mf, &bio);
+				TRACE_END_ARG(tspan, "write", filefmt[i].suffixes[0]);
+				TRACE_BEGIN(tspan);
+				if(mf_gzip_wrclose(&bio) == -1) {
+					res = -1;
+				}
+				TRACE_END(tspan, "compress");
+				return res;
+			}
+
+			TRACE_BEGIN(tspan);
+			/* writers issue lots of small writes, combine them into large blocks */
+			if(mf_bufio_wropen(&bio, io, mf->writev) == -1) {
+				res = filefmt[i].save(mf, io);
+			} else {
+				if(mf->progress) {
+					mf_bufio_progress(&bio, save_progress, (void*)mf);
+				}
+				res = filefmt[i].save(mf, &bio);
+				if(mf_bufio_wrclose(&bio) == -1) {
+					res = -1;
+				}
+			}
+			TRACE_END_ARG(tspan, "write", filefmt[i].suffixes[0]);
+			return res;
 		}
 	}
 	return -1;
@@ -611,6 +1281,7 @@ int mf_save_userio(const struct mf_meshfile *mf, const struct mf_userio *io, uns
 void mf_clear_mesh(struct mf_mesh *m)
 {
 	free(m->name);
+	m->name = 0;
 	mf_dynarr_free(m->vertex); m->vertex = 0;
 	mf_dynarr_free(m->normal); m->normal = 0;
 	mf_dynarr_free(m->tangent); m->tangent = 0;
@@ -621,16 +1292,61 @@ void mf_clear_mesh(struct mf_mesh *m)
 	init_aabox(&m->aabox);
 
 	m->num_verts = m->num_faces = 0;
+	m->dirty |= MF_DIRTY_GEOM;
 }
 
-#define PUSH(arr, item) \
+struct mf_mesh *mf_clone_mesh(const struct mf_mesh *m)
+{
+	struct mf_mesh *clone;
+
+	if(!(clone = malloc(sizeof *clone))) {
+		return 0;
+	}
+	memcpy(clone, m, sizeof *clone);
+	if(m->name && !(clone->name = strdup(m->name))) {
+		free(clone);
+		return 0;
+	}
+	clone->vertex = mf_dynarr_ref(m->vertex);
+	clone->normal = mf_dynarr_ref(m->normal);
+	clone->tangent = mf_dynarr_ref(m->tangent);
+	clone->texcoord = mf_dynarr_ref(m->texcoord);
+	clone->color = mf_dynarr_ref(m->color);
+	clone->faces = mf_dynarr_ref(m->faces);
+	clone->immed = 0;
+	return clone;
+}
+
+#define UNSHARE(arr) \
 	do { \
-		if(!(arr) && !((arr) = mf_dynarr_alloc(0, sizeof *(arr)))) { \
+		void *tmp; \
+		if(mf_dynarr_shared(arr)) { \
+			if(!(tmp = mf_dynarr_unshare(arr))) return -1; \
+			(arr) = tmp; \
+		} \
+	} while(0)
+
+int mf_unshare_mesh(struct mf_mesh *m)
+{
+	UNSHARE(m->vertex);
+	UNSHARE(m->normal);
+	UNSHARE(m->tangent);
+	UNSHARE(m->texcoord);
+	UNSHARE(m->color);
+	UNSHARE(m->faces);
+	return 0;
+}
+
+#define PUSH(arr, item, tag) \
+	do { \
+		void *tmp; \
+		if(!(arr) && !((arr) = mf_dynarr_alloc_tag(0, sizeof *(arr), tag))) { \
 			return -1; \
 		} \
-		if(!((arr) = mf_dynarr_push((arr), &(item)))) { \
+		if(!(tmp = mf_dynarr_push((arr), &(item)))) { \
 			return -1; \
 		} \
+		(arr) = tmp; \
 	} while(0)
 
 
@@ -640,8 +1356,9 @@ int mf_add_vertex(struct mf_mesh *m, float x, float y, float z)
 	v.x = x;
 	v.y = y;
 	v.z = z;
-	PUSH(m->vertex, v);
+	PUSH(m->vertex, v, MF_MEM_ATTR);
 	m->num_verts++;
+	m->dirty |= MF_DIRTY_GEOM;
 
 	if(x < m->aabox.vmin.x) m->aabox.vmin.x = x;
 	if(y < m->aabox.vmin.y) m->aabox.vmin.y = y;
@@ -658,7 +1375,7 @@ int mf_add_normal(struct mf_mesh *m, float x, float y, float z)
 	v.x = x;
 	v.y = y;
 	v.z = z;
-	PUSH(m->normal, v);
+	PUSH(m->normal, v, MF_MEM_ATTR);
 	return 0;
 }
 
@@ -668,7 +1385,7 @@ int mf_add_tangent(struct mf_mesh *m, float x, float y, float z)
 	v.x = x;
 	v.y = y;
 	v.z = z;
-	PUSH(m->tangent, v);
+	PUSH(m->tangent, v, MF_MEM_ATTR);
 	return 0;
 }
 
@@ -677,7 +1394,7 @@ int mf_add_texcoord(struct mf_mesh *m, float x, float y)
 	mf_vec2 v;
 	v.x = x;
 	v.y = y;
-	PUSH(m->texcoord, v);
+	PUSH(m->texcoord, v, MF_MEM_ATTR);
 	return 0;
 }
 
@@ -688,7 +1405,7 @@ int mf_add_color(struct mf_mesh *m, float r, float g, float b, float a)
 	v.y = g;
 	v.z = b;
 	v.w = a;
-	PUSH(m->color, v);
+	PUSH(m->color, v, MF_MEM_ATTR);
 	return 0;
 }
 
@@ -698,7 +1415,7 @@ int mf_add_triangle(struct mf_mesh *m, int a, int b, int c)
 	f.vidx[0] = a;
 	f.vidx[1] = b;
 	f.vidx[2] = c;
-	PUSH(m->faces, f);
+	PUSH(m->faces, f, MF_MEM_FACES);
 	m->num_faces++;
 	return 0;
 }
@@ -716,11 +1433,9 @@ enum {
 	COLOR		= 8
 };
 
-#define IM_MAGIC	0xaaed55de
-struct immed {
-	unsigned int magic;
+struct mf_immed {
 	int prim, vnum;
-	void *orig_udata;
+	int hint;
 	unsigned int attrmask;
 
 	mf_vec3 norm, tang;
@@ -728,82 +1443,205 @@ struct immed {
 	mf_vec4 col;
 };
 
-#define IMMED(m) \
-	(m)->udata; if(((struct immed*)(m)->udata)->magic != IM_MAGIC) return
+static int im_attr(void **arr, int szelem, const void *src, const void *cur, int count, int hint,
+		int nprev);
+static int im_prims(struct mf_mesh *m, struct mf_immed *im, int count);
 
 int mf_begin(struct mf_mesh *m, enum mf_primitive prim)
 {
-	struct immed *im;
+	return mf_begin_hint(m, prim, 0);
+}
+
+int mf_begin_hint(struct mf_mesh *m, enum mf_primitive prim, int num_verts)
+{
+	struct mf_immed *im;
+	int num_faces;
+	void *tmp;
 
 	if(!(im = calloc(1, sizeof *im))) {
 		return -1;
 	}
-	im->magic = IM_MAGIC;
 	im->prim = prim;
-	im->orig_udata = m->udata;
+	im->hint = num_verts;
 
 	mf_clear_mesh(m);
-	m->udata = im;
+	free(m->immed);
+	m->immed = im;
+
+	if(num_verts > 0) {
+		num_faces = num_verts / prim * (prim == MF_QUADS ? 2 : 1);
+		if(!(m->vertex = mf_dynarr_alloc_tag(0, sizeof *m->vertex, MF_MEM_ATTR)) ||
+				!(m->faces = mf_dynarr_alloc_tag(0, sizeof *m->faces, MF_MEM_FACES))) {
+			return -1;
+		}
+		if((tmp = mf_dynarr_reserve(m->vertex, num_verts))) {
+			m->vertex = tmp;
+		}
+		if((tmp = mf_dynarr_reserve(m->faces, num_faces))) {
+			m->faces = tmp;
+		}
+	}
 	return 0;
 }
 
 void mf_end(struct mf_mesh *m)
 {
-	struct immed *im = m->udata;
-	if(im->magic == IM_MAGIC) {
-		m->udata = im->orig_udata;
-		free(im);
-	}
+	free(m->immed);
+	m->immed = 0;
 }
 
 int mf_vertex(struct mf_mesh *m, float x, float y, float z)
 {
-	int res;
-	unsigned int vidx;
-	struct immed *im = m->udata;
-	if(im->magic != IM_MAGIC) return -1;
+	mf_vec3 v;
+
+	v.x = x;
+	v.y = y;
+	v.z = z;
+	return mf_vertices(m, 1, &v.x, 0, 0, 0);
+}
+
+/* append count vertices. Attributes passed as null pointers are set to the
+ * current value, if one has been set with mf_normal/mf_texcoord/etc.
+ */
+int mf_vertices(struct mf_mesh *m, int count, const float *pos, const float *norm,
+		const float *uv, const float *col)
+{
+	int i, nprev;
+	struct mf_immed *im = m->immed;
+	mf_vec3 *vptr;
+
+	if(!im || count <= 0) {
+		return im ? 0 : -1;
+	}
+
+	if(im_attr((void**)&m->vertex, sizeof *m->vertex, pos, 0, count, im->hint, 0) == -1) {
+		return -1;
+	}
+	vptr = m->vertex + m->num_verts;
+	for(i=0; i<count; i++) {
+		expand_aabox(&m->aabox, vptr[i]);
+	}
+	nprev = m->num_verts;
+	m->num_verts += count;
+	m->dirty |= MF_DIRTY_GEOM;
+
+	if(norm) {
+		memcpy(&im->norm, norm + (count - 1) * 3, sizeof im->norm);
+		im->attrmask |= NORMAL;
+	}
+	if(uv) {
+		memcpy(&im->uv, uv + (count - 1) * 2, sizeof im->uv);
+		im->attrmask |= TEXCOORD;
+	}
+	if(col) {
+		memcpy(&im->col, col + (count - 1) * 4, sizeof im->col);
+		im->attrmask |= COLOR;
+	}
 
-	if(mf_add_vertex(m, x, y, z) == -1) return -1;
 	if(im->attrmask & NORMAL) {
-		if(mf_add_normal(m, im->norm.x, im->norm.y, im->norm.z) == -1) {
+		if(im_attr((void**)&m->normal, sizeof *m->normal, norm, &im->norm, count, im->hint, nprev) == -1) {
 			return -1;
 		}
 	}
 	if(im->attrmask & TANGENT) {
-		if(mf_add_tangent(m, im->tang.x, im->tang.y, im->tang.z) == -1) {
+		if(im_attr((void**)&m->tangent, sizeof *m->tangent, 0, &im->tang, count, im->hint, nprev) == -1) {
 			return -1;
 		}
 	}
 	if(im->attrmask & TEXCOORD) {
-		if(mf_add_texcoord(m, im->uv.x, im->uv.y) == -1) {
+		if(im_attr((void**)&m->texcoord, sizeof *m->texcoord, uv, &im->uv, count, im->hint, nprev) == -1) {
 			return -1;
 		}
 	}
 	if(im->attrmask & COLOR) {
-		if(mf_add_color(m, im->col.x, im->col.y, im->col.z, im->col.w) == -1) {
+		if(im_attr((void**)&m->color, sizeof *m->color, col, &im->col, count, im->hint, nprev) == -1) {
 			return -1;
 		}
 	}
 
-	if(++im->vnum >= im->prim) {
-		im->vnum = 0;
-		vidx = mf_dynarr_size(m->vertex) - im->prim;
+	return im_prims(m, im, count);
+}
 
-		if(im->prim == 4) {
-			res = mf_add_quad(m, vidx, vidx + 1, vidx + 2, vidx + 3);
-		} else {
-			res = mf_add_triangle(m, vidx, vidx + 1, vidx + 2);
-		}
-		if(res == -1) {
+/* append count items to an attribute array, either from src, or copies of cur.
+ * If the array doesn't exist yet, it's created with nprev zeroed items first, to
+ * keep it in step with the vertex array.
+ */
+static int im_attr(void **arr, int szelem, const void *src, const void *cur, int count, int hint,
+		int nprev)
+{
+	int i, start;
+	char *dest;
+	void *tmp;
+
+	if(!*arr) {
+		if(!(*arr = mf_dynarr_alloc_tag(nprev, szelem, MF_MEM_ATTR))) {
 			return -1;
 		}
+		memset(*arr, 0, nprev * szelem);
+		if(hint > 0 && (tmp = mf_dynarr_reserve(*arr, hint))) {
+			*arr = tmp;
+		}
+	}
+
+	start = mf_dynarr_size(*arr);
+	if(!(tmp = mf_dynarr_pushn(*arr, src, count))) {
+		return -1;
+	}
+	*arr = tmp;
+
+	if(!src) {
+		dest = (char*)tmp + start * szelem;
+		for(i=0; i<count; i++) {
+			memcpy(dest, cur, szelem);
+			dest += szelem;
+		}
 	}
 	return 0;
 }
 
+/* add faces for all primitives completed by the last count vertices */
+static int im_prims(struct mf_mesh *m, struct mf_immed *im, int count)
+{
+	int i, nprim, vidx;
+	mf_face *f;
+	void *tmp;
+
+	vidx = m->num_verts - count - im->vnum;
+	count += im->vnum;
+	nprim = count / im->prim;
+	im->vnum = count % im->prim;
+	if(!nprim) return 0;
+
+	if(!m->faces && !(m->faces = mf_dynarr_alloc_tag(0, sizeof *m->faces, MF_MEM_FACES))) {
+		return -1;
+	}
+	if(!(tmp = mf_dynarr_pushn(m->faces, 0, im->prim == MF_QUADS ? nprim * 2 : nprim))) {
+		return -1;
+	}
+	m->faces = tmp;
+	f = m->faces + m->num_faces;
+
+	for(i=0; i<nprim; i++) {
+		f->vidx[0] = vidx;
+		f->vidx[1] = vidx + 1;
+		f->vidx[2] = vidx + 2;
+		f++;
+		if(im->prim == MF_QUADS) {
+			f->vidx[0] = vidx;
+			f->vidx[1] = vidx + 2;
+			f->vidx[2] = vidx + 3;
+			f++;
+		}
+		vidx += im->prim;
+	}
+	m->num_faces = f - m->faces;
+	return 0;
+}
+
 void mf_normal(struct mf_mesh *m, float x, float y, float z)
 {
-	struct immed *im = IMMED(m);
+	struct mf_immed *im;
+	if(!(im = m->immed)) return;
 	im->norm.x = x;
 	im->norm.y = y;
 	im->norm.z = z;
@@ -812,7 +1650,8 @@ void mf_normal(struct mf_mesh *m, float x, float y, float z)
 
 void mf_tangent(struct mf_mesh *m, float x, float y, float z)
 {
-	struct immed *im = IMMED(m);
+	struct mf_immed *im;
+	if(!(im = m->immed)) return;
 	im->tang.x = x;
 	im->tang.y = y;
 	im->tang.z = z;
@@ -821,7 +1660,8 @@ void mf_tangent(struct mf_mesh *m, float x, float y, float z)
 
 void mf_texcoord(struct mf_mesh *m, float u, float v)
 {
-	struct immed *im = IMMED(m);
+	struct mf_immed *im;
+	if(!(im = m->immed)) return;
 	im->uv.x = u;
 	im->uv.y = v;
 	im->attrmask |= TEXCOORD;
@@ -829,7 +1669,8 @@ void mf_texcoord(struct mf_mesh *m, float u, float v)
 
 void mf_color(struct mf_mesh *m, float r, float g, float b, float a)
 {
-	struct immed *im = IMMED(m);
+	struct mf_immed *im;
+	if(!(im = m->immed)) return;
 	im->col.x = r;
 	im->col.y = g;
 	im->col.z = b;
@@ -839,43 +1680,27 @@ void mf_color(struct mf_mesh *m, float r, float g, float b, float a)
 
 void mf_vertexv(struct mf_mesh *m, float *v)
 {
-	mf_vertex(m, v[0], v[1], v[2]);
+	mf_vertices(m, 1, v, 0, 0, 0);
 }
 
 void mf_normalv(struct mf_mesh *m, float *v)
 {
-	struct immed *im = IMMED(m);
-	im->norm.x = v[0];
-	im->norm.y = v[1];
-	im->norm.z = v[2];
-	im->attrmask |= NORMAL;
+	mf_normal(m, v[0], v[1], v[2]);
 }
 
 void mf_tangentv(struct mf_mesh *m, float *v)
 {
-	struct immed *im = IMMED(m);
-	im->tang.x = v[0];
-	im->tang.y = v[1];
-	im->tang.z = v[2];
-	im->attrmask |= TANGENT;
+	mf_tangent(m, v[0], v[1], v[2]);
 }
 
 void mf_texcooordv(struct mf_mesh *m, float *v)
 {
-	struct immed *im = IMMED(m);
-	im->uv.x = v[0];
-	im->uv.y = v[1];
-	im->attrmask |= TEXCOORD;
+	mf_texcoord(m, v[0], v[1]);
 }
 
 void mf_colorv(struct mf_mesh *m, float *v)
 {
-	struct immed *im = IMMED(m);
-	im->col.x = v[0];
-	im->col.y = v[1];
-	im->col.z = v[2];
-	im->col.w = v[3];
-	im->attrmask |= COLOR;
+	mf_color(m, v[0], v[1], v[2], v[3]);
 }
 
 int mf_calc_normals(struct mf_mesh *m)
@@ -883,13 +1708,19 @@ int mf_calc_normals(struct mf_mesh *m)
 	int i, j;
 	mf_vec3 *v[3], *nptr, vab, vac, vn;
 	struct mf_face *f;
+	double tspan;
 
 	if(!m->num_verts || !m->num_faces) {
 		return -1;
 	}
+	TRACE_BEGIN(tspan);
 
+	if(mf_dynarr_shared(m->normal)) {
+		mf_dynarr_free(m->normal);	/* overwritten anyway, no need to copy */
+		m->normal = 0;
+	}
 	if(!m->normal) {
-		if(!(m->normal = mf_dynarr_alloc(m->num_verts, sizeof *m->normal))) {
+		if(!(m->normal = mf_dynarr_alloc_tag(m->num_verts, sizeof *m->normal, MF_MEM_ATTR))) {
 			return -1;
 		}
 	}
@@ -921,6 +1752,7 @@ int mf_calc_normals(struct mf_mesh *m)
 	for(i=0; i<m->num_verts; i++) {
 		mf_normalize(m->normal + i);
 	}
+	TRACE_END_ARG(tspan, "calc_normals", m->name);
 	return 0;
 }
 
@@ -932,10 +1764,12 @@ int mf_calc_tangents(struct mf_mesh *m)
 	mf_vec3 vpos[3], vnorm[3], *vtang[3], va, vb, udir, nprojt;
 	mf_vec2 uv[3], ta, tb;
 	struct mf_face *face;
+	double tspan;
 
 	if(!m->num_verts || !m->num_faces || !m->texcoord) {
 		return -1;
 	}
+	TRACE_BEGIN(tspan);
 
 	if(!m->normal) {
 		if(mf_calc_normals(m) == -1) {
@@ -943,8 +1777,12 @@ int mf_calc_tangents(struct mf_mesh *m)
 		}
 	}
 
+	if(mf_dynarr_shared(m->tangent)) {
+		mf_dynarr_free(m->tangent);
+		m->tangent = 0;
+	}
 	if(!m->tangent) {
-		if(!(m->tangent = mf_dynarr_alloc(m->num_verts, sizeof *m->tangent))) {
+		if(!(m->tangent = mf_dynarr_alloc_tag(m->num_verts, sizeof *m->tangent, MF_MEM_ATTR))) {
 			return -1;
 		}
 	}
@@ -991,6 +1829,15 @@ int mf_calc_tangents(struct mf_mesh *m)
 			mf_normalize(vtang[j]);
 		}
 	}
+	TRACE_END_ARG(tspan, "calc_tangents", m->name);
+	return 0;
+}
+
+static int unshare_xform(struct mf_mesh *m)
+{
+	UNSHARE(m->vertex);
+	UNSHARE(m->normal);
+	UNSHARE(m->tangent);
 	return 0;
 }
 
@@ -999,9 +1846,15 @@ void mf_transform_mesh(struct mf_mesh *m, const float *mat)
 	unsigned int i;
 	float dirmat[16];
 
+	if(unshare_xform(m) == -1) {
+		fprintf(stderr, "mf_transform_mesh: failed to copy shared mesh data\n");
+		return;
+	}
+
 	for(i=0; i<m->num_verts; i++) {
 		mf_transform(m->vertex + i, m->vertex + i, mat);
 	}
+	m->dirty |= MF_DIRTY_GEOM | MF_DIRTY_BOUNDS;
 	if(!m->normal && !m->tangent) {
 		return;
 	}
@@ -1021,6 +1874,11 @@ void mf_transform_mesh(struct mf_mesh *m, const float *mat)
 	}
 }
 
+void mf_invalidate_mesh(struct mf_mesh *m)
+{
+	m->dirty |= MF_DIRTY_GEOM | MF_DIRTY_BOUNDS;
+}
+
 /* node functions */
 int mf_node_add_mesh(struct mf_node *n, struct mf_mesh *m)
 {
@@ -1039,6 +1897,7 @@ int mf_node_add_mesh(struct mf_node *n, struct mf_mesh *m)
 	}
 	n->meshes = tmp;
 	n->num_meshes++;
+	n->dirty |= MF_DIRTY_BOUNDS;
 	return 0;
 }
 
@@ -1051,6 +1910,7 @@ int mf_node_remove_mesh(struct mf_node *n, struct mf_mesh *m)
 		if(n->meshes[i] == m) {
 			n->meshes[i] = n->meshes[--n->num_meshes];
 			n->meshes = mf_dynarr_pop(n->meshes);
+			n->dirty |= MF_DIRTY_BOUNDS;
 			break;
 		}
 	}
@@ -1071,6 +1931,7 @@ int mf_node_add_child(struct mf_node *n, struct mf_node *c)
 		mf_node_remove_child(c->parent, c);
 	}
 	c->parent = n;
+	c->dirty |= MF_DIRTY_XFORM;
 	return 0;
 }
 
@@ -1089,10 +1950,17 @@ int mf_node_remove_child(struct mf_node *n, struct mf_node *c)
 
 	if(c->parent == n) {
 		c->parent = 0;
+		c->dirty |= MF_DIRTY_XFORM;
 	}
 	return 0;
 }
 
+void mf_node_set_matrix(struct mf_node *n, const float *mat)
+{
+	memcpy(n->matrix, mat, sizeof n->matrix);
+	n->dirty |= MF_DIRTY_XFORM;
+}
+
 void mf_node_update_xform(struct mf_node *n)
 {
 	int i;
@@ -1102,6 +1970,7 @@ void mf_node_update_xform(struct mf_node *n)
 	} else {
 		memcpy(n->global_matrix, n->matrix, sizeof n->global_matrix);
 	}
+	n->dirty = (n->dirty & ~MF_DIRTY_XFORM) | MF_DIRTY_BOUNDS;
 
 	for(i=0; i<n->num_child; i++) {
 		mf_node_update_xform(n->child[i]);
@@ -1109,76 +1978,262 @@ void mf_node_update_xform(struct mf_node *n)
 }
 
 /* utility functions */
+int mf_add_asset_path(struct mf_meshfile *mf, const char *dir)
+{
+	char *str;
+	void *tmp;
+
+	if(!(str = strdup(dir))) {
+		return -1;
+	}
+	if(!(tmp = mf_dynarr_push(mf->searchpath, &str))) {
+		free(str);
+		return -1;
+	}
+	mf->searchpath = tmp;
+	rb_clear(mf->assetpath);
+	return 0;
+}
+
+void mf_clear_asset_paths(struct mf_meshfile *mf)
+{
+	int i, num = mf_dynarr_size(mf->searchpath);
+
+	for(i=0; i<num; i++) {
+		free(mf->searchpath[i]);
+	}
+	mf->searchpath = mf_dynarr_clear(mf->searchpath);
+	rb_clear(mf->assetpath);
+}
+
+/* look for fname relative to the directory of the file being loaded, then as
+ * is, then in each search path, and finally just its last path component in
+ * each search path. Results are cached, including failures, so that every
+ * distinct name hits the filesystem only once.
+ */
 const char *mf_find_asset(const struct mf_meshfile *mf, const char *fname)
 {
+	int i, num;
 	struct rbnode *rbn;
-	char *key, *pathbuf;
-	FILE *fp;
+	struct mf_nameent *key;
+	const char *base;
+	char *path = 0;
 
-	if(!fname || !mf->dirname) {
+	if(!fname) {
 		return fname;
 	}
 
 	if((rbn = rb_find(mf->assetpath, (void*)fname))) {
-		return rbn->data;
+		return rbn->data ? rbn->data : fname;
 	}
 
-	if(!(key = strdup(fname))) {
-		return fname;
+	if(mf->dirname) {
+		path = probe_asset(mf->dirname, fname);
+	}
+	if(!path) {
+		path = probe_asset(0, fname);
+	}
+
+	num = mf_dynarr_size(mf->searchpath);
+	for(i=0; !path && i<num; i++) {
+		path = probe_asset(mf->searchpath[i], fname);
+	}
+
+	base = fname + strlen(fname);
+	while(base > fname && base[-1] != '/' && base[-1] != '\\') base--;
+	if(base > fname) {
+		for(i=0; !path && i<num; i++) {
+			path = probe_asset(mf->searchpath[i], base);
+		}
 	}
-	if(!(pathbuf = malloc(strlen(fname) + strlen(mf->dirname) + 2))) {
+
+	if(!(key = mf_nameidx_add(mf->names, fname))) {
+		free(path);
 		return fname;
 	}
+	rb_insert(mf->assetpath, (void*)key->str, path);
+	return path ? path : fname;
+}
+
+int mf_resolve_assets(struct mf_meshfile *mf)
+{
+	int i, j, k, num, missing = 0;
+	struct mf_texmap *map;
 
-	sprintf(pathbuf, "%s/%s", mf->dirname, fname);
-	if((fp = fopen(pathbuf, "r"))) {
-		fclose(fp);
-		rb_insert(mf->assetpath, key, pathbuf);
-		return pathbuf;
+	num = mf_dynarr_size(mf->mtl);
+	for(i=0; i<num; i++) {
+		for(j=0; j<MF_NUM_MTLATTR; j++) {
+			map = &mf->mtl[i]->attr[j].map;
+			missing += resolve_asset(mf, &map->name);
+			for(k=0; k<6; k++) {
+				missing += resolve_asset(mf, map->cube + k);
+			}
+		}
 	}
+	return missing;
+}
 
-	strcpy(pathbuf, fname);
-	if((fp = fopen(pathbuf, "r"))) {
-		fclose(fp);
-		rb_insert(mf->assetpath, key, pathbuf);
-		return pathbuf;
+static char *probe_asset(const char *dir, const char *fname)
+{
+	char *path;
+	struct stat st;
+
+	if(!(path = malloc((dir ? strlen(dir) + 1 : 0) + strlen(fname) + 1))) {
+		return 0;
+	}
+	if(dir) {
+		sprintf(path, "%s/%s", dir, fname);
+	} else {
+		strcpy(path, fname);
 	}
 
-	return fname;
+	if(stat(path, &st) == -1 || (st.st_mode & S_IFMT) == S_IFDIR) {
+		free(path);
+		return 0;
+	}
+	return path;
 }
 
+/* replace *nameptr with the path it resolves to, returns 1 if it's missing */
+static int resolve_asset(struct mf_meshfile *mf, char **nameptr)
+{
+	const char *path;
+	char *str;
+
+	if(!*nameptr) {
+		return 0;
+	}
+	if((path = mf_find_asset(mf, *nameptr)) == *nameptr) {
+		return 1;
+	}
+	if(strcmp(path, *nameptr) != 0 && (str = strdup(path))) {
+		free(*nameptr);
+		*nameptr = str;
+	}
+	return 0;
+}
+
+/* keys are owned by mf->names */
 static void assetpath_rbdelnode(struct rbnode *n, void *cls)
 {
-	free(n->key);
 	free(n->data);
 }
 
+/* keep the first object with each name, like the linear search used to. If
+ * we fail to add the name, lookups for this name will just fail.
+ */
+static void add_name(struct mf_meshfile *mf, int type, const char *name, void *obj)
+{
+	struct mf_nameent *ent;
+
+	if((ent = mf_nameidx_add(mf->names, name)) && !ent->obj[type]) {
+		ent->obj[type] = obj;
+	}
+}
+
 static void init_aabox(mf_aabox *box)
 {
 	box->vmin.x = box->vmin.y = box->vmin.z = FLT_MAX;
 	box->vmax.x = box->vmax.y = box->vmax.z = -FLT_MAX;
 }
 
-static void calc_aabox(struct mf_meshfile *mf)
+/* update the global matrices of all subtrees whose root has been moved */
+static void update_node_xform(struct mf_node *n)
 {
-	long k;
-	int i, j, nnodes = mf_num_nodes(mf);
+	int i;
+
+	if(n->dirty & MF_DIRTY_XFORM) {
+		mf_node_update_xform(n);
+		return;
+	}
+	for(i=0; i<n->num_child; i++) {
+		update_node_xform(n->child[i]);
+	}
+}
+
+static void update_bounds(struct mf_meshfile *mf)
+{
+	int i, j, num = mf_num_nodes(mf);
 	struct mf_node *n;
 	struct mf_mesh *m;
-	mf_vec3 v;
+	double tspan;
 
-	init_aabox(&mf->aabox);
+	TRACE_BEGIN(tspan);
+
+	for(i=0; i<num; i++) {
+		n = mf->nodes[i];
+		if(!n->parent) {
+			update_node_xform(n);
+		}
+	}
 
-	for(i=0; i<nnodes; i++) {
-		n = mf_get_node(mf, i);
+	/* recompute the bounds of nodes which have moved, or whose meshes have
+	 * changed. Mesh flags are cleared afterwards, since meshes can be shared.
+	 */
+	init_aabox(&mf->aabox);
+	for(i=0; i<num; i++) {
+		n = mf->nodes[i];
 		for(j=0; j<n->num_meshes; j++) {
 			m = n->meshes[j];
-			for(k=0; k<m->num_verts; k++) {
-				mf_transform(&v, m->vertex + k, n->global_matrix);
-				expand_aabox(&mf->aabox, v);
+			if(m->dirty & MF_DIRTY_BOUNDS) {
+				calc_mesh_aabox(m);
 			}
+			if(m->dirty & MF_DIRTY_GEOM) {
+				n->dirty |= MF_DIRTY_BOUNDS;
+			}
+		}
+		if(n->dirty & MF_DIRTY_BOUNDS) {
+			calc_node_aabox(n);
 		}
+		union_aabox(&mf->aabox, &n->aabox);
 	}
+
+	for(i=0; i<num; i++) {
+		n = mf->nodes[i];
+		for(j=0; j<n->num_meshes; j++) {
+			n->meshes[j]->dirty &= ~MF_DIRTY_GEOM;
+		}
+	}
+	TRACE_END(tspan, "update_bounds");
+}
+
+static void calc_mesh_aabox(struct mf_mesh *m)
+{
+	unsigned int i;
+
+	init_aabox(&m->aabox);
+	for(i=0; i<m->num_verts; i++) {
+		expand_aabox(&m->aabox, m->vertex[i]);
+	}
+	m->dirty &= ~MF_DIRTY_BOUNDS;
+}
+
+static void calc_node_aabox(struct mf_node *n)
+{
+	long k;
+	int i;
+	struct mf_mesh *m;
+	mf_vec3 v;
+
+	init_aabox(&n->aabox);
+	for(i=0; i<n->num_meshes; i++) {
+		m = n->meshes[i];
+		for(k=0; k<m->num_verts; k++) {
+			mf_transform(&v, m->vertex + k, n->global_matrix);
+			expand_aabox(&n->aabox, v);
+		}
+	}
+	n->dirty &= ~MF_DIRTY_BOUNDS;
+}
+
+static void union_aabox(mf_aabox *box, const mf_aabox *b)
+{
+	if(b->vmin.x < box->vmin.x) box->vmin.x = b->vmin.x;
+	if(b->vmin.y < box->vmin.y) box->vmin.y = b->vmin.y;
+	if(b->vmin.z < box->vmin.z) box->vmin.z = b->vmin.z;
+	if(b->vmax.x > box->vmax.x) box->vmax.x = b->vmax.x;
+	if(b->vmax.y > box->vmax.y) box->vmax.y = b->vmax.y;
+	if(b->vmax.z > box->vmax.z) box->vmax.z = b->vmax.z;
 }
 
 static void expand_aabox(mf_aabox *box, mf_vec3 v)
@@ -1223,6 +2278,11 @@ static long io_seek(void *file, long offs, int from)
 	return ftell(file);
 }
 
+int mf_is_stdio(const struct mf_userio *io)
+{
+	return mf_base_userio(io)->open == io_open;
+}
+
 int mf_fgetc(const struct mf_userio *io)
 {
 	unsigned char c;
@@ -1237,6 +2297,11 @@ char *mf_fgets(char *buf, int sz, const struct mf_userio *io)
 	int c;
 	char *dest = buf;
 	char *endp = buf + sz - 1;
+
+	if(mf_is_bufio(io)) {
+		return mf_bufio_gets(buf, sz, io);
+	}
+
 	while((c = mf_fgetc(io)) != -1) {
 		if(dest < endp) {
 			*dest++ = c;
@@ -1272,32 +2337,29 @@ int mf_fprintf(const struct mf_userio *io, const char *fmt, ...)
 {
 	int len;
 	va_list ap;
-	static char *buf;
-	static int bufsz;
-
-	if(!buf) {
-		bufsz = 256;
-		if(!(buf = malloc(bufsz))) {
-			return -1;
-		}
-	}
+	char stackbuf[256];
+	char *buf = stackbuf;
+	int bufsz = sizeof stackbuf;
 
+	/* formatting into a local buffer, to be usable from multiple threads
+	 * concurrently. Only very long lines need to hit the heap.
+	 */
 	for(;;) {
 		va_start(ap, fmt);
 		len = vsnprintf(buf, bufsz, fmt, ap);
 		va_end(ap);
 
-		if(len > bufsz) {
+		if(len >= bufsz) {
 			/* C99-compliant vsnprintf, tells us how much space we need */
-			free(buf);
-			bufsz = len;
+			if(buf != stackbuf) free(buf);
+			bufsz = len + 1;
 			if(!(buf = malloc(bufsz))) {
 				return -1;
 			}
 
 		} else if(len == -1) {
 			/* non-C99 vsnprintf, try doubling the buffer until it succeeds */
-			free(buf);
+			if(buf != stackbuf) free(buf);
 			bufsz <<= 1;
 			if(!(buf = malloc(bufsz))) {
 				return -1;
@@ -1309,5 +2371,8 @@ int mf_fprintf(const struct mf_userio *io, const char *fmt, ...)
 	}
 
 	mf_fputs(buf, io);
+	if(buf != stackbuf) {
+		free(buf);
+	}
 	return len;
 }
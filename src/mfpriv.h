@@ -20,6 +20,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "meshfile.h"
 #include "rbtree.h"
+#include "nameidx.h"
 #include "util.h"
 
 #ifdef __GNUC__
@@ -51,8 +52,25 @@ struct mf_meshfile {
 	struct mf_node **nodes, **topnodes;
 	mf_aabox aabox;
 
-	struct rbtree *assetpath;
+	struct rbtree *assetpath;	/* asset name -> resolved path, or null if missing */
+	char **searchpath;
+	struct mf_nameidx *names;	/* name -> object index, also asset path keys */
 	unsigned int flags;
+	struct mf_load_stats stats;
+	int stats_valid;		/* last load was done with MF_STATS, only load sets it */
+	struct mf_memacct {
+		long cur[MF_NUM_MEMCAT], total;
+		long peak[MF_NUM_MEMCAT], peak_total;
+		int over;
+	} memacct;
+	unsigned long memlimit;	/* per-load memory budget, 0 for unlimited */
+
+	mf_progress_func progress;
+	void *progress_cls;
+	long progress_total;
+	int progress_stop;		/* set when the progress callback cancels */
+
+	mf_writev_func writev;	/* optional writev for mf_save_userio */
 };
 
 struct filefmt {
@@ -65,6 +83,80 @@ struct filefmt {
 
 extern struct filefmt filefmt[MF_NUM_FMT];
 
+#if defined(MF_NO_THREADS)
+#define MF_TLS
+#elif defined(_MSC_VER)
+#define MF_TLS	__declspec(thread)
+#elif defined(__GNUC__)
+#define MF_TLS	__thread
+#elif __STDC_VERSION__ >= 201112L
+#define MF_TLS	_Thread_local
+#endif
+
+/* cancel flag of the asynchronous operation running on the current thread.
+ * It's kept per thread rather than in the meshfile, because several async
+ * saves of the same meshfile may run at once. Without thread local storage,
+ * mf_cancel only stops operations which haven't started yet.
+ */
+#ifdef MF_TLS
+extern MF_TLS volatile int *mf_cur_cancel;
+#define MF_ASYNC_CANCELLED()	(mf_cur_cancel && *mf_cur_cancel)
+#else
+#define MF_ASYNC_CANCELLED()	0
+#endif
+
+/* loaders and writers check this at chunk or record boundaries, to bail out
+ * early if an asynchronous operation has been cancelled, or the progress
+ * callback asked to stop.
+ */
+#define MF_CANCELLED(mf)	(MF_ASYNC_CANCELLED() || (mf)->progress_stop)
+
+/* calls the progress callback if there is one. Returns -1 if it cancels */
+#define MF_PROGRESS(mf, stage, done, total) \
+	((mf)->progress ? mf_report_progress(mf, stage, done, total) : 0)
+int mf_report_progress(const struct mf_meshfile *mf, int stage, long done, long total);
+
+/* meshfile being loaded on the current thread, if the load was started with
+ * MF_STATS or has a memory budget. Used to count and account allocations by
+ * category, where the compiler supports thread local storage.
+ *
+ * MF_MEM_CHECK(size) evaluates to -1 if allocating size more bytes would exceed
+ * the memory budget of the current load, 0 otherwise.
+ */
+#ifdef MF_TLS
+extern MF_TLS struct mf_meshfile *mf_cur_load;
+
+void mf_mem_acct(int cat, long delta);
+int mf_mem_check(unsigned long size);
+
+#define MF_COUNT_ALLOC()		do { if(mf_cur_load) mf_cur_load->stats.num_allocs++; } while(0)
+#define MF_MEM_ACCT(cat, delta)	do { if(mf_cur_load) mf_mem_acct(cat, delta); } while(0)
+#define MF_MEM_CHECK(size) \
+	(mf_cur_load && mf_cur_load->memlimit ? mf_mem_check(size) : 0)
+#else
+#define MF_COUNT_ALLOC()
+#define MF_MEM_ACCT(cat, delta)
+#define MF_MEM_CHECK(size)		0
+#endif
+
+int mf_load_buffer(struct mf_meshfile *mf, const char *fname, void *buf, long size,
+		unsigned int flags);
+
+int mf_copy_mtl(struct mf_material *dest, const struct mf_material *src);
+
+/* true if io (under any buffering) is the default stdio backend of mf_load */
+int mf_is_stdio(const struct mf_userio *io);
+
+/* shared material library cache (mtlcache.c). mf_mtlcache_get adds copies of
+ * the cached materials of a library to mf, and returns -1 if the cache is
+ * disabled, or the library isn't in the cache or has changed on disk, leaving
+ * the materials of mf as they were. mf_mtlcache_put stores copies of the
+ * materials of a newly parsed library. Paths are checked against the
+ * filesystem, so the cache is only for libraries read through mf_is_stdio.
+ */
+int mf_mtlcache_get(struct mf_meshfile *mf, const char *path);
+void mf_mtlcache_put(const char *path, struct mf_material **mtl, int count);
+
 
 int mf_fgetc(const struct mf_userio *io);
 char *mf_fgets(char *buf, int sz, const struct mf_userio *io);
@@ -74,8 +166,26 @@ int mf_fprintf(const struct mf_userio *io, const char *fmt, ...);
 
 int mf_strcasecmp(const char *a, const char *b);
 
+/* MF_BIGEND is 0 or 1 when the byte order is known at compile time, otherwise
+ * TARGET_BIGEND falls back to checking at runtime.
+ */
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__)
+#define MF_BIGEND	(__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#elif defined(__BIG_ENDIAN__) || defined(__MIPSEB__) || defined(_MIPSEB) || \
+	defined(__sgi) || defined(__sparc) || defined(__ARMEB__) || defined(__AARCH64EB__)
+#define MF_BIGEND	1
+#elif defined(__LITTLE_ENDIAN__) || defined(__MIPSEL__) || defined(__i386__) || \
+	defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64) || defined(_M_ARM) || \
+	defined(_M_ARM64) || defined(__ARMEL__) || defined(__AARCH64EL__)
+#define MF_BIGEND	0
+#endif
+
+#ifdef MF_BIGEND
+#define TARGET_BIGEND		MF_BIGEND
+#else
 #define TARGET_BIGEND		(*(uint16_t*)"ab" == 0x6162)
-#define TARGET_LITEND		(*(uint16_t*)"ab" == 0x6261)
+#endif
+#define TARGET_LITEND		(!TARGET_BIGEND)
 
 #define BSWAP16(x)		((x) = (((uint16_t)(x) >> 8) | ((uint16_t)(x) << 8)))
 #define BSWAP32(x)		((x) = ((uint32_t)(x) >> 24) | ((uint32_t)(x) << 24) | \
@@ -86,4 +196,15 @@ int mf_strcasecmp(const char *a, const char *b);
 #define CONV_LE32(x)	do if(TARGET_BIGEND) BSWAP32(x); while(0)
 #define CONV_LEFLT(x)	do if(TARGET_BIGEND) BSWAPFLT(x); while(0)
 
+/* convert arrays of 32bit or 16bit little endian values (in place) to native
+ * byte order or back. No-ops on little endian targets.
+ */
+#if defined(MF_BIGEND) && !MF_BIGEND
+#define mf_le32_array(ptr, count)	((void)0)
+#define mf_le16_array(ptr, count)	((void)0)
+#else
+void mf_le32_array(void *ptr, long count);
+void mf_le16_array(void *ptr, long count);
+#endif
+
 #endif	/* MFPRIV_H_ */
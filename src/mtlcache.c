@@ -0,0 +1,221 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "mfpriv.h"
+#include "rbtree.h"
+#include "dynarr.h"
+#include "nameidx.h"
+
+#ifndef MF_NO_THREADS
+#include <pthread.h>
+#endif
+
+struct mtllib {
+	time_t mtime;
+	off_t size;
+	struct mf_material *mtl;	/* dynarr */
+};
+
+static int get_stat(const char *path, struct stat *st);
+static void remove_mtl(struct mf_meshfile *mf, int first);
+static void free_mtllib(struct mtllib *lib);
+static void del_rbnode(struct rbnode *n, void *cls);
+
+static int enabled;
+static struct rbtree *cache;
+
+#ifndef MF_NO_THREADS
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK	pthread_mutex_lock(&lock)
+#define UNLOCK	pthread_mutex_unlock(&lock)
+#else
+#define LOCK
+#define UNLOCK
+#endif
+
+void mf_mtl_cache(int enable)
+{
+	LOCK;
+	enabled = enable;
+	UNLOCK;
+	if(!enable) {
+		mf_flush_mtl_cache();
+	}
+}
+
+void mf_flush_mtl_cache(void)
+{
+	LOCK;
+	if(cache) {
+		rb_free(cache);
+		cache = 0;
+	}
+	UNLOCK;
+}
+
+int mf_mtlcache_get(struct mf_meshfile *mf, const char *path)
+{
+	int i, num, first, res = -1;
+	struct stat st;
+	struct rbnode *rbn;
+	struct mtllib *lib;
+	struct mf_material *mtl;
+
+	if(get_stat(path, &st) == -1) {
+		return -1;
+	}
+
+	LOCK;
+	if(!enabled || !cache || !(rbn = rb_find(cache, (void*)path))) {
+		goto end;
+	}
+	lib = rbn->data;
+	if(lib->mtime != st.st_mtime || lib->size != st.st_size) {
+		goto end;
+	}
+
+	first = mf_num_materials(mf);
+	num = mf_dynarr_size(lib->mtl);
+	for(i=0; i<num; i++) {
+		if(!(mtl = malloc(sizeof *mtl))) {
+			remove_mtl(mf, first);
+			goto end;
+		}
+		if(mf_copy_mtl(mtl, lib->mtl + i) == -1 || mf_add_material(mf, mtl) == -1) {
+			mf_free_mtl(mtl);
+			remove_mtl(mf, first);
+			goto end;
+		}
+	}
+	res = 0;
+end:
+	UNLOCK;
+	return res;
+}
+
+void mf_mtlcache_put(const char *path, struct mf_material **mtl, int count)
+{
+	int i, j;
+	struct stat st;
+	struct mtllib *lib;
+	struct rbnode *rbn;
+	char *key;
+
+	LOCK;
+	i = enabled;
+	UNLOCK;
+	if(!i || get_stat(path, &st) == -1) {
+		return;
+	}
+
+	if(!(lib = malloc(sizeof *lib))) {
+		return;
+	}
+	lib->mtime = st.st_mtime;
+	lib->size = st.st_size;
+	if(!(lib->mtl = mf_dynarr_alloc(count, sizeof *lib->mtl))) {
+		free(lib);
+		return;
+	}
+	for(i=0; i<count; i++) {
+		if(mf_copy_mtl(lib->mtl + i, mtl[i]) == -1) {
+			for(j=0; j<i; j++) {
+				mf_destroy_mtl(lib->mtl + j);
+			}
+			mf_dynarr_free(lib->mtl);
+			free(lib);
+			return;
+		}
+	}
+
+	LOCK;
+	if(!enabled) {
+		goto fail;	/* disabled while we were copying */
+	}
+	if(!cache) {
+		if(!(cache = rb_create(RB_KEY_STRING))) {
+			goto fail;
+		}
+		rb_set_delete_func(cache, del_rbnode, 0);
+	}
+	if((rbn = rb_find(cache, (void*)path))) {
+		/* stale entry for a library which has changed since */
+		free_mtllib(rbn->data);
+		rbn->data = lib;
+	} else {
+		if(!(key = strdup(path))) {
+			goto fail;
+		}
+		rb_insert(cache, key, lib);
+	}
+	UNLOCK;
+	return;
+
+fail:
+	UNLOCK;
+	free_mtllib(lib);
+}
+
+/* only cache real files, which we can check for modifications */
+static int get_stat(const char *path, struct stat *st)
+{
+	if(stat(path, st) == -1 || (st->st_mode & S_IFMT) != S_IFREG) {
+		return -1;
+	}
+	return 0;
+}
+
+/* undo a partial mf_mtlcache_get, so that the library can be parsed instead
+ * without ending up with duplicate materials
+ */
+static void remove_mtl(struct mf_meshfile *mf, int first)
+{
+	int num;
+	struct mf_material *mtl;
+	struct mf_nameent *ent;
+
+	while((num = mf_num_materials(mf)) > first) {
+		mtl = mf->mtl[num - 1];
+		mf->mtl = mf_dynarr_pop(mf->mtl);
+		if(mf_num_materials(mf) == num) break;
+
+		if((ent = mf_nameidx_find(mf->names, mtl->name)) && ent->obj[MF_NAME_MTL] == mtl) {
+			ent->obj[MF_NAME_MTL] = 0;
+		}
+		mf_free_mtl(mtl);
+	}
+}
+
+static void free_mtllib(struct mtllib *lib)
+{
+	int i, num = mf_dynarr_size(lib->mtl);
+
+	for(i=0; i<num; i++) {
+		mf_destroy_mtl(lib->mtl + i);
+	}
+	mf_dynarr_free(lib->mtl);
+	free(lib);
+}
+
+static void del_rbnode(struct rbnode *n, void *cls)
+{
+	free(n->key);
+	free_mtllib(n->data);
+}
@@ -0,0 +1,215 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "nameidx.h"
+#include "mfpriv.h"
+
+#define INIT_TABSZ	64
+#define BLOCK_SIZE	16384
+
+struct block {
+	struct block *next;
+	unsigned long size;
+};
+
+struct mf_nameidx {
+	struct mf_nameent *tab;		/* open addressing, tabsz is a power of two */
+	unsigned int tabsz, count;
+
+	struct block *blocks;
+	char *top;
+	unsigned long left;
+	unsigned long blkbytes;
+};
+
+static unsigned int hash_str(const char *s);
+static struct mf_nameent *lookup(struct mf_nameidx *ni, const char *str, unsigned int hash);
+static int grow(struct mf_nameidx *ni);
+static char *key_strdup(struct mf_nameidx *ni, const char *str);
+
+struct mf_nameidx *mf_nameidx_create(void)
+{
+	struct mf_nameidx *ni;
+
+	if(!(ni = calloc(1, sizeof *ni))) {
+		return 0;
+	}
+	if(!(ni->tab = calloc(INIT_TABSZ, sizeof *ni->tab))) {
+		free(ni);
+		return 0;
+	}
+	ni->tabsz = INIT_TABSZ;
+	return ni;
+}
+
+void mf_nameidx_free(struct mf_nameidx *ni)
+{
+	if(!ni) return;
+
+	mf_nameidx_clear(ni);
+	MF_MEM_ACCT(MF_MEM_NAMES, -(long)(ni->tabsz * sizeof *ni->tab));
+	free(ni->tab);
+	free(ni);
+}
+
+void mf_nameidx_clear(struct mf_nameidx *ni)
+{
+	struct block *blk;
+
+	while(ni->blocks) {
+		blk = ni->blocks;
+		ni->blocks = blk->next;
+		MF_MEM_ACCT(MF_MEM_NAMES, -(long)blk->size);
+		free(blk);
+	}
+	ni->top = 0;
+	ni->left = 0;
+	ni->blkbytes = 0;
+
+	memset(ni->tab, 0, ni->tabsz * sizeof *ni->tab);
+	ni->count = 0;
+}
+
+unsigned long mf_nameidx_memsize(struct mf_nameidx *ni)
+{
+	return sizeof *ni + ni->tabsz * sizeof *ni->tab + ni->blkbytes;
+}
+
+struct mf_nameent *mf_nameidx_find(struct mf_nameidx *ni, const char *str)
+{
+	struct mf_nameent *ent = lookup(ni, str, hash_str(str));
+	return ent->str ? ent : 0;
+}
+
+struct mf_nameent *mf_nameidx_add(struct mf_nameidx *ni, const char *str)
+{
+	unsigned int hash = hash_str(str);
+	struct mf_nameent *ent;
+
+	ent = lookup(ni, str, hash);
+	if(ent->str) {
+		return ent;
+	}
+
+	/* keep the load factor under 3/4 */
+	if((ni->count + 1) * 4 > ni->tabsz * 3) {
+		if(grow(ni) == -1) {
+			return 0;
+		}
+		ent = lookup(ni, str, hash);
+	}
+
+	if(!(ent->str = key_strdup(ni, str))) {
+		return 0;
+	}
+	ent->hash = hash;
+	ni->count++;
+	return ent;
+}
+
+/* FNV-1a */
+static unsigned int hash_str(const char *s)
+{
+	unsigned int hash = 2166136261u;
+
+	while(*s) {
+		hash ^= (unsigned char)*s++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/* returns the matching entry, or the empty slot where it would go */
+static struct mf_nameent *lookup(struct mf_nameidx *ni, const char *str, unsigned int hash)
+{
+	unsigned int mask = ni->tabsz - 1;
+	unsigned int idx = hash & mask;
+	struct mf_nameent *ent;
+
+	for(;;) {
+		ent = ni->tab + idx;
+		if(!ent->str || (ent->hash == hash && strcmp(ent->str, str) == 0)) {
+			return ent;
+		}
+		idx = (idx + 1) & mask;
+	}
+}
+
+static int grow(struct mf_nameidx *ni)
+{
+	unsigned int i, idx, mask, newsz = ni->tabsz * 2;
+	struct mf_nameent *newtab;
+
+	if(!(newtab = calloc(newsz, sizeof *newtab))) {
+		return -1;
+	}
+	mask = newsz - 1;
+
+	for(i=0; i<ni->tabsz; i++) {
+		if(!ni->tab[i].str) continue;
+
+		idx = ni->tab[i].hash & mask;
+		while(newtab[idx].str) {
+			idx = (idx + 1) & mask;
+		}
+		newtab[idx] = ni->tab[i];
+	}
+
+	MF_MEM_ACCT(MF_MEM_NAMES, (long)((newsz - ni->tabsz) * sizeof *newtab));
+	free(ni->tab);
+	ni->tab = newtab;
+	ni->tabsz = newsz;
+	return 0;
+}
+
+static char *key_strdup(struct mf_nameidx *ni, const char *str)
+{
+	char *res;
+	struct block *blk;
+	unsigned long len = strlen(str) + 1;
+	unsigned long blksz;
+
+	if(len > ni->left) {
+		blksz = len > BLOCK_SIZE / 4 ? len : BLOCK_SIZE;
+		if(!(blk = malloc(sizeof *blk + blksz))) {
+			return 0;
+		}
+		blk->size = sizeof *blk + blksz;
+		ni->blkbytes += blk->size;
+		MF_MEM_ACCT(MF_MEM_NAMES, (long)blk->size);
+		if(blksz > BLOCK_SIZE / 4 && ni->blocks) {
+			/* oversized string, put its block behind the current one */
+			blk->next = ni->blocks->next;
+			ni->blocks->next = blk;
+			res = (char*)(blk + 1);
+			memcpy(res, str, len);
+			return res;
+		}
+		blk->next = ni->blocks;
+		ni->blocks = blk;
+		ni->top = (char*)(blk + 1);
+		ni->left = blksz;
+	}
+
+	res = ni->top;
+	memcpy(res, str, len);
+	ni->top += len;
+	ni->left -= len;
+	return res;
+}
@@ -0,0 +1,56 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef NAMEIDX_H_
+#define NAMEIDX_H_
+
+/* Hashed name index. Each distinct string gets one entry, carrying a few object
+ * pointers, which the meshfile uses to find meshes, materials and nodes by
+ * name, and the asset path cache uses for its keys. The index keeps its own
+ * copy of each key, in arena blocks which are only released all together by
+ * mf_nameidx_clear or mf_nameidx_free, so that keys don't depend on the
+ * lifetime of the objects they point to.
+ *
+ * This is not a string interning pool: the name fields of meshes, materials
+ * and nodes, and texture paths, are still allocated separately, owned by the
+ * objects and freed with them, so equal names don't share storage and can't
+ * be compared by pointer.
+ *
+ * Entry pointers returned by find/add are only valid until the next call to
+ * mf_nameidx_add, the key strings themselves stay put.
+ */
+enum { MF_NAME_MESH, MF_NAME_MTL, MF_NAME_NODE, MF_NAME_NUM_OBJ };
+
+struct mf_nameent {
+	const char *str;
+	unsigned int hash;
+	void *obj[MF_NAME_NUM_OBJ];
+};
+
+struct mf_nameidx;
+
+struct mf_nameidx *mf_nameidx_create(void);
+void mf_nameidx_free(struct mf_nameidx *ni);
+void mf_nameidx_clear(struct mf_nameidx *ni);
+
+/* bytes allocated for the index, its key blocks and table */
+unsigned long mf_nameidx_memsize(struct mf_nameidx *ni);
+
+struct mf_nameent *mf_nameidx_find(struct mf_nameidx *ni, const char *str);
+struct mf_nameent *mf_nameidx_add(struct mf_nameidx *ni, const char *str);
+
+#endif	/* NAMEIDX_H_ */
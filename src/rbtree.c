@@ -9,6 +9,7 @@ the terms of the 3-clause BSD license. See COPYING for details.
 #include <stdlib.h>
 #include <string.h>
 #include "rbtree.h"
+#include "mfpriv.h"
 
 #define INT2PTR(x)	((void*)(x))
 #define PTR2INT(x)	((int)(x))
@@ -280,6 +281,7 @@ static void del_tree(struct rbnode *node, rb_del_func_t delfunc, void *cls)
 	if(delfunc) {
 		delfunc(node, cls);
 	}
+	MF_MEM_ACCT(MF_MEM_RBTREE, -(long)sizeof *node);
 	free(node);
 }
 
@@ -289,6 +291,7 @@ static struct rbnode *insert(struct rbtree *rb, struct rbnode *tree, void *key,
 
 	if(!tree) {
 		struct rbnode *node = rb->alloc(sizeof *node);
+		MF_MEM_ACCT(MF_MEM_RBTREE, sizeof *node);
 		node->red = 1;
 		node->key = key;
 		node->data = data;
@@ -359,6 +362,7 @@ static struct rbnode *delete(struct rbtree *rb, struct rbnode *tree, void *key)
 			if(rb->del) {
 				rb->del(tree, rb->del_cls);
 			}
+			MF_MEM_ACCT(MF_MEM_RBTREE, -(long)sizeof *tree);
 			rb->free(tree);
 			return 0;
 		}
@@ -454,6 +458,7 @@ static struct rbnode *del_min(struct rbtree *rb, struct rbnode *tree)
 		if(rb->del) {
 			rb->del(tree->left, rb->del_cls);
 		}
+		MF_MEM_ACCT(MF_MEM_RBTREE, -(long)sizeof *tree);
 		rb->free(tree->left);
 		return 0;
 	}
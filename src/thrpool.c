@@ -0,0 +1,246 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "meshfile.h"
+#include "thrpool.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+struct job {
+	mf_tpool_func func;
+	void *cls;
+	struct job *next;
+};
+
+struct mf_thrpool {
+	int num_threads;
+#ifndef MF_NO_THREADS
+	pthread_t *threads;
+
+	struct job *qhead, *qtail;
+	int quit;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+#endif
+};
+
+#ifndef MF_NO_THREADS
+static void *thread_func(void *arg);
+static void init_worker_pool(void);
+
+static pthread_once_t worker_pool_once = PTHREAD_ONCE_INIT;
+#endif
+static struct mf_thrpool *worker_pool;
+
+
+struct mf_thrpool *mf_tpool_create(int num_threads)
+{
+	struct mf_thrpool *tpool;
+#ifndef MF_NO_THREADS
+	int i;
+#endif
+
+	if(!(tpool = calloc(1, sizeof *tpool))) {
+		fprintf(stderr, "mf_tpool_create: failed to allocate thread pool\n");
+		return 0;
+	}
+
+#ifndef MF_NO_THREADS
+	if(num_threads <= 0) {
+		num_threads = mf_num_processors();
+	}
+	if(!(tpool->threads = malloc(num_threads * sizeof *tpool->threads))) {
+		fprintf(stderr, "mf_tpool_create: failed to allocate thread array\n");
+		free(tpool);
+		return 0;
+	}
+	pthread_mutex_init(&tpool->lock, 0);
+	pthread_cond_init(&tpool->cond, 0);
+
+	for(i=0; i<num_threads; i++) {
+		if(pthread_create(tpool->threads + i, 0, thread_func, tpool) != 0) {
+			fprintf(stderr, "mf_tpool_create: failed to create worker thread %d\n", i);
+			break;
+		}
+	}
+	tpool->num_threads = i;
+	if(!i) {
+		mf_tpool_destroy(tpool);
+		return 0;
+	}
+#endif
+	return tpool;
+}
+
+void mf_tpool_destroy(struct mf_thrpool *tpool)
+{
+#ifndef MF_NO_THREADS
+	int i;
+	struct job *job;
+
+	if(!tpool) return;
+
+	pthread_mutex_lock(&tpool->lock);
+	tpool->quit = 1;
+	pthread_cond_broadcast(&tpool->cond);
+	pthread_mutex_unlock(&tpool->lock);
+
+	for(i=0; i<tpool->num_threads; i++) {
+		pthread_join(tpool->threads[i], 0);
+	}
+	free(tpool->threads);
+
+	while(tpool->qhead) {
+		job = tpool->qhead;
+		tpool->qhead = job->next;
+		free(job);
+	}
+
+	pthread_mutex_destroy(&tpool->lock);
+	pthread_cond_destroy(&tpool->cond);
+#endif
+	free(tpool);
+}
+
+int mf_tpool_num_threads(struct mf_thrpool *tpool)
+{
+	return tpool->num_threads;
+}
+
+int mf_tpool_enqueue(struct mf_thrpool *tpool, mf_tpool_func func, void *cls)
+{
+#ifndef MF_NO_THREADS
+	struct job *job;
+
+	if(!(job = malloc(sizeof *job))) {
+		return -1;
+	}
+	job->func = func;
+	job->cls = cls;
+	job->next = 0;
+
+	pthread_mutex_lock(&tpool->lock);
+	if(tpool->qtail) {
+		tpool->qtail->next = job;
+	} else {
+		tpool->qhead = job;
+	}
+	tpool->qtail = job;
+	pthread_cond_signal(&tpool->cond);
+	pthread_mutex_unlock(&tpool->lock);
+#else
+	func(cls);
+#endif
+	return 0;
+}
+
+struct mf_thrpool *mf_worker_pool(void)
+{
+#ifndef MF_NO_THREADS
+	pthread_once(&worker_pool_once, init_worker_pool);
+#else
+	if(!worker_pool) {
+		worker_pool = mf_tpool_create(0);
+	}
+#endif
+	return worker_pool;
+}
+
+int mf_set_num_threads(int num)
+{
+#ifndef MF_NO_THREADS
+	struct mf_thrpool *tpool, *prev;
+
+	if(num < 0) num = 0;
+
+	pthread_once(&worker_pool_once, init_worker_pool);
+	if(worker_pool && worker_pool->num_threads == (num ? num : mf_num_processors())) {
+		return 0;
+	}
+	if(!(tpool = mf_tpool_create(num))) {
+		return -1;
+	}
+	prev = worker_pool;
+	worker_pool = tpool;
+	mf_tpool_destroy(prev);	/* waits for any pending jobs */
+#endif
+	return 0;
+}
+
+int mf_get_num_threads(void)
+{
+	struct mf_thrpool *tpool = mf_worker_pool();
+	return tpool ? tpool->num_threads : 0;
+}
+
+int mf_num_processors(void)
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	long num = sysconf(_SC_NPROCESSORS_ONLN);
+	return num > 0 ? num : 1;
+#else
+	return 1;
+#endif
+}
+
+#ifndef MF_NO_THREADS
+static void *thread_func(void *arg)
+{
+	struct mf_thrpool *tpool = arg;
+	struct job *job;
+
+	pthread_mutex_lock(&tpool->lock);
+	for(;;) {
+		while(!tpool->qhead && !tpool->quit) {
+			pthread_cond_wait(&tpool->cond, &tpool->lock);
+		}
+		if(!tpool->qhead) break;	/* quit, once the queue is drained */
+
+		job = tpool->qhead;
+		if(!(tpool->qhead = job->next)) {
+			tpool->qtail = 0;
+		}
+		pthread_mutex_unlock(&tpool->lock);
+
+		job->func(job->cls);
+		free(job);
+
+		pthread_mutex_lock(&tpool->lock);
+	}
+	pthread_mutex_unlock(&tpool->lock);
+	return 0;
+}
+
+static void init_worker_pool(void)
+{
+	if(!(worker_pool = mf_tpool_create(0))) {
+		fprintf(stderr, "meshfile: failed to create worker thread pool\n");
+	}
+}
+#endif
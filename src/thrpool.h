@@ -0,0 +1,46 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef THRPOOL_H_
+#define THRPOOL_H_
+
+#ifndef MF_NO_THREADS
+#include <pthread.h>
+#endif
+
+struct mf_thrpool;
+
+typedef void (*mf_tpool_func)(void*);
+
+/* pass 0 for num_threads to start one thread per processor */
+struct mf_thrpool *mf_tpool_create(int num_threads);
+/* jobs still in the queue are executed before the threads exit */
+void mf_tpool_destroy(struct mf_thrpool *tpool);
+
+int mf_tpool_num_threads(struct mf_thrpool *tpool);
+
+/* queue up a job to be executed by the next available worker thread. If the
+ * library was built without thread support, the job is executed immediately.
+ */
+int mf_tpool_enqueue(struct mf_thrpool *tpool, mf_tpool_func func, void *cls);
+
+/* library-wide worker pool, created on first use */
+struct mf_thrpool *mf_worker_pool(void);
+
+int mf_num_processors(void);
+
+#endif	/* THRPOOL_H_ */
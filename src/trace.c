@@ -0,0 +1,185 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mfpriv.h"
+#include "trace.h"
+
+#ifdef MF_TRACE
+
+#ifndef MF_NO_THREADS
+#include <pthread.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#define getpid()	((int)GetCurrentProcessId())
+#else
+#include <unistd.h>
+#endif
+
+static void write_event(const char *name, const char *detail, double start, double dur,
+		int tid, void *cls);
+static const char *escape(char *buf, int sz, const char *s);
+static int thread_id(void);
+
+volatile int mf_tracing;
+
+static mf_trace_func trace_func;
+static void *trace_cls;
+static struct mf_userio trace_io;
+static int num_events, pid;
+
+#ifndef MF_NO_THREADS
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK()		pthread_mutex_lock(&trace_lock)
+#define UNLOCK()	pthread_mutex_unlock(&trace_lock)
+#else
+#define LOCK()
+#define UNLOCK()
+#endif
+
+#ifdef MF_TLS
+static MF_TLS int tid;
+static int next_tid;
+#endif
+
+
+int mf_trace_start(const struct mf_userio *io)
+{
+	LOCK();
+	if(trace_func) {
+		UNLOCK();
+		fprintf(stderr, "mf_trace_start: tracing already in progress\n");
+		return -1;
+	}
+	trace_io = *io;
+	pid = getpid();
+	num_events = 0;
+	mf_fputs("[\n", &trace_io);
+
+	trace_func = write_event;
+	trace_cls = 0;
+	mf_tracing = 1;
+	UNLOCK();
+	return 0;
+}
+
+int mf_trace_callback(mf_trace_func func, void *cls)
+{
+	LOCK();
+	if(trace_func) {
+		UNLOCK();
+		fprintf(stderr, "mf_trace_callback: tracing already in progress\n");
+		return -1;
+	}
+	trace_func = func;
+	trace_cls = cls;
+	mf_tracing = 1;
+	UNLOCK();
+	return 0;
+}
+
+void mf_trace_stop(void)
+{
+	LOCK();
+	if(trace_func == write_event) {
+		mf_fputs("\n]\n", &trace_io);
+	}
+	trace_func = 0;
+	mf_tracing = 0;
+	UNLOCK();
+}
+
+void mf_trace_span(const char *name, const char *detail, double t0)
+{
+	double t1 = mf_get_time();
+
+	LOCK();
+	if(trace_func) {
+		trace_func(name, detail, t0, t1 - t0, thread_id(), trace_cls);
+	}
+	UNLOCK();
+}
+
+/* complete ("X") events, with timestamps in microseconds */
+static void write_event(const char *name, const char *detail, double start, double dur,
+		int tid, void *cls)
+{
+	char buf[256];
+
+	mf_fprintf(&trace_io, "%s{\"name\":\"%s\",\"cat\":\"meshfile\",\"ph\":\"X\",\"ts\":%.3f,"
+			"\"dur\":%.3f,\"pid\":%d,\"tid\":%d", num_events++ ? ",\n" : "", name,
+			start * 1e6, dur * 1e6, pid, tid);
+	if(detail) {
+		mf_fprintf(&trace_io, ",\"args\":{\"detail\":\"%s\"}}", escape(buf, sizeof buf, detail));
+	} else {
+		mf_fputs("}", &trace_io);
+	}
+}
+
+static const char *escape(char *buf, int sz, const char *s)
+{
+	char *dest = buf;
+
+	while(*s && dest < buf + sz - 2) {
+		if(*s == '"' || *s == '\\') {
+			*dest++ = '\\';
+			*dest++ = *s;
+		} else if((unsigned char)*s >= 32) {
+			*dest++ = *s;
+		}
+		s++;
+	}
+	*dest = 0;
+	return buf;
+}
+
+/* small sequential thread ids, in the order threads first emit a span. Called
+ * with the lock held.
+ */
+static int thread_id(void)
+{
+#ifdef MF_TLS
+	if(!tid) tid = ++next_tid;
+	return tid;
+#else
+	return 0;
+#endif
+}
+
+#else	/* !MF_TRACE */
+
+int mf_trace_start(const struct mf_userio *io)
+{
+	fprintf(stderr, "mf_trace_start: library built without tracing\n");
+	return -1;
+}
+
+int mf_trace_callback(mf_trace_func func, void *cls)
+{
+	fprintf(stderr, "mf_trace_callback: library built without tracing\n");
+	return -1;
+}
+
+void mf_trace_stop(void)
+{
+}
+
+#endif	/* MF_TRACE */
@@ -0,0 +1,42 @@
+/*
+meshfile - a simple C library for reading/writing 3D mesh file formats
+Copyright (C) 2025  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "util.h"
+
+/* Scoped trace spans, compiled in only when the library is built with
+ * MF_TRACE (configure --enable-trace). TRACE_BEGIN records the start time in
+ * a double variable, if tracing is active, and TRACE_END emits the span. When
+ * tracing is compiled out, they do nothing.
+ */
+#ifdef MF_TRACE
+extern volatile int mf_tracing;
+
+void mf_trace_span(const char *name, const char *detail, double t0);
+
+#define TRACE_BEGIN(t)				((t) = mf_tracing ? mf_get_time() : 0.0)
+#define TRACE_END(t, name)			do { if((t) > 0.0) mf_trace_span(name, 0, t); } while(0)
+#define TRACE_END_ARG(t, name, arg)	do { if((t) > 0.0) mf_trace_span(name, arg, t); } while(0)
+#else
+#define TRACE_BEGIN(t)				((void)((t) = 0.0))
+#define TRACE_END(t, name)			((void)(t))
+#define TRACE_END_ARG(t, name, arg)	((void)(t))
+#endif
+
+#endif	/* TRACE_H_ */
@@ -20,6 +20,18 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <string.h>
 #include <math.h>
 #include "util.h"
+#include "mfpriv.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
 
 static int b64bits(int c);
 
@@ -165,7 +177,7 @@ void mf_transform_dir(mf_vec3 *dest, const mf_vec3 *v, const float *m)
 
 void mf_mult_matrix(float *dest, const float *a, const float *b)
 {
-	int i, j;
+	int i;
 	float res[16];
 	float *resptr;
 	const float *brow = b;
@@ -176,13 +188,34 @@ void mf_mult_matrix(float *dest, const float *a, const float *b)
 		resptr = dest;
 	}
 
+#ifdef __SSE__
+	{
+		__m128 a0 = _mm_loadu_ps(a);
+		__m128 a1 = _mm_loadu_ps(a + 4);
+		__m128 a2 = _mm_loadu_ps(a + 8);
+		__m128 a3 = _mm_loadu_ps(a + 12);
+		__m128 r;
+
+		for(i=0; i<4; i++) {
+			r = _mm_mul_ps(_mm_set1_ps(brow[0]), a0);
+			r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(brow[1]), a1));
+			r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(brow[2]), a2));
+			r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(brow[3]), a3));
+			_mm_storeu_ps(resptr, r);
+			resptr += 4;
+			brow += 4;
+		}
+	}
+#else
 	for(i=0; i<4; i++) {
+		int j;
 		for(j=0; j<4; j++) {
 			*resptr++ = brow[0] * a[j] + brow[1] * a[4 + j] +
 				brow[2] * a[8 + j] + brow[3] * a[12 + j];
 		}
 		brow += 4;
 	}
+#endif
 	if(resptr == res + 16) {
 		memcpy(dest, res, sizeof res);
 	}
@@ -234,15 +267,24 @@ void mf_quat_matrix(float *m, const mf_vec4 *q)
 	m[10] = sz;
 }
 
+/* translation * rotation * scale, composed directly: the rotation columns
+ * scaled by s, and p in the last column.
+ */
 void mf_prs_matrix(float *mat, const mf_vec3 *p, const mf_vec4 *r, const mf_vec3 *s)
 {
-	float tmp[16];
-
 	mf_quat_matrix(mat, r);
-	mf_trans_matrix(tmp, p);
-	mf_mult_matrix(mat, tmp, mat);
-	mf_scale_matrix(tmp, s);
-	mf_mult_matrix(mat, tmp, mat);
+	mat[0] *= s->x;
+	mat[1] *= s->x;
+	mat[2] *= s->x;
+	mat[4] *= s->y;
+	mat[5] *= s->y;
+	mat[6] *= s->y;
+	mat[8] *= s->z;
+	mat[9] *= s->z;
+	mat[10] *= s->z;
+	mat[12] = p->x;
+	mat[13] = p->y;
+	mat[14] = p->z;
 }
 
 void mf_transpose_matrix(float *dest, const float *m)
@@ -323,12 +365,53 @@ static float cgm_mdet(const float *m)
 		m[2] * cgm_msubdet(m, 0, 2) - m[3] * cgm_msubdet(m, 0, 3);
 }
 
+/* inverse of an affine matrix: invert the upper 3x3 part, and transform the
+ * negated translation by it.
+ */
+static int inverse_affine(float *inv, const float *m)
+{
+	float c00, c01, c02, det, s;
+	float res[16];
+
+	c00 = m[5] * m[10] - m[6] * m[9];
+	c01 = m[6] * m[8] - m[4] * m[10];
+	c02 = m[4] * m[9] - m[5] * m[8];
+	det = m[0] * c00 + m[1] * c01 + m[2] * c02;
+	if(det == 0.0f) return -1;
+	s = 1.0f / det;
+
+	res[0] = c00 * s;
+	res[1] = (m[2] * m[9] - m[1] * m[10]) * s;
+	res[2] = (m[1] * m[6] - m[2] * m[5]) * s;
+	res[4] = c01 * s;
+	res[5] = (m[0] * m[10] - m[2] * m[8]) * s;
+	res[6] = (m[2] * m[4] - m[0] * m[6]) * s;
+	res[8] = c02 * s;
+	res[9] = (m[1] * m[8] - m[0] * m[9]) * s;
+	res[10] = (m[0] * m[5] - m[1] * m[4]) * s;
+
+	res[12] = -(res[0] * m[12] + res[4] * m[13] + res[8] * m[14]);
+	res[13] = -(res[1] * m[12] + res[5] * m[13] + res[9] * m[14]);
+	res[14] = -(res[2] * m[12] + res[6] * m[13] + res[10] * m[14]);
+
+	res[3] = res[7] = res[11] = 0.0f;
+	res[15] = 1.0f;
+
+	memcpy(inv, res, sizeof res);
+	return 0;
+}
+
 int mf_inverse_matrix(float *inv, const float *m)
 {
 	int i, j;
 	float tmp[16];
-	float inv_det;
-	float det = cgm_mdet(m);
+	float inv_det, det;
+
+	if(m[3] == 0.0f && m[7] == 0.0f && m[11] == 0.0f && m[15] == 1.0f) {
+		return inverse_affine(inv, m);
+	}
+
+	det = cgm_mdet(m);
 	if(det == 0.0f) return -1;
 	inv_det = 1.0f / det;
 
@@ -345,6 +428,35 @@ int mf_inverse_matrix(float *inv, const float *m)
 	return 0;
 }
 
+#if !defined(MF_BIGEND) || MF_BIGEND
+void mf_le32_array(void *ptr, long count)
+{
+	uint32_t *p = ptr;
+
+	if(!TARGET_BIGEND) return;
+
+	while(count-- > 0) {
+#ifdef __GNUC__
+		*p = __builtin_bswap32(*p);
+#else
+		BSWAP32(*p);
+#endif
+		p++;
+	}
+}
+
+void mf_le16_array(void *ptr, long count)
+{
+	uint16_t *p = ptr;
+
+	if(!TARGET_BIGEND) return;
+
+	while(count-- > 0) {
+		BSWAP16(*p);
+		p++;
+	}
+}
+#endif
 
 void mf_print_matrix(const float *m)
 {
@@ -354,3 +466,23 @@ void mf_print_matrix(const float *m)
 		m += 4;
 	}
 }
+
+double mf_get_time(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, cnt;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&cnt);
+	return (double)cnt.QuadPart / (double)freq.QuadPart;
+#else
+	struct timeval tv;
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+	if(clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+		return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+	}
+#endif
+	gettimeofday(&tv, 0);
+	return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+#endif
+}
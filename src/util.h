@@ -43,6 +43,9 @@ void mf_scale_matrix(float *m, const mf_vec3 *v);
 void mf_quat_matrix(float *m, const mf_vec4 *q);
 void mf_prs_matrix(float *mat, const mf_vec3 *p, const mf_vec4 *r, const mf_vec3 *s);
 
+/* monotonic time in seconds */
+double mf_get_time(void);
+
 int mf_inverse_matrix(float *inv, const float *mat);
 void mf_transpose_matrix(float *dest, const float *m);
 void mf_print_matrix(const float *m);